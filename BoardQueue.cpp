@@ -0,0 +1,151 @@
+#ifndef BOARDQUEUE_CPP
+#define BOARDQUEUE_CPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <MineBoard.cpp>
+
+// Boards generated ahead of time
+//
+// A worker thread keeps up to depth freshly reset boards ready. Restarting
+// swaps the caller's board pointer with a ready one and hands the old board
+// back, and the worker resets it in the background for a later restart. Boards
+// are only ever touched by one thread at a time, passing between the two
+// under the lock, so a board in steady state costs no allocation and no reset
+// on the caller's thread. When no board is ready the caller's board is reset
+// in place as before, and counted.
+
+#define BOARDQUEUE_DEPTH 2
+
+class BoardQueue
+{
+    public:
+    // index_openings turns on the opening index of the boards it makes
+    BoardQueue(int width, int height, int num_mines, int depth = BOARDQUEUE_DEPTH, int index_openings = 0);
+    ~BoardQueue();
+
+    // Replace *board with a freshly reset board, taking the old one for reuse.
+    // Returns 1 if a ready board was swapped in, 0 if *board was reset in place
+    int next(MineBoard** board);
+    // Boards made from now on have this size, ready ones are made again
+    void resize(int width, int height, int num_mines);
+
+    long numRestarts() { return restarts; }
+    long numEmpty() { return empty; }  // restarts that found no board ready
+
+    private:
+    void worker_main();
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::vector<MineBoard*> ready;
+    std::vector<MineBoard*> spare;  // handed back, to be reset
+    int depth;
+    int size_x, size_y, num_mines;
+    int index_openings;
+    int generation;  // bumped by resize, a board made for an older one is not ready
+    int stop;
+    long restarts;
+    long empty;
+};
+
+BoardQueue::BoardQueue(int width, int height, int num_mines_in, int depth_in, int index_openings_in)
+{
+    depth = depth_in;
+    size_x = width, size_y = height, num_mines = num_mines_in;
+    index_openings = index_openings_in;
+    generation = 0;
+    stop = 0;
+    restarts = 0;
+    empty = 0;
+    worker = std::thread(&BoardQueue::worker_main, this);
+}
+
+BoardQueue::~BoardQueue()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = 1;
+    }
+    wake.notify_all();
+    worker.join();
+    for (size_t i=0; i<ready.size(); i++) { delete ready[i]; }
+    for (size_t i=0; i<spare.size(); i++) { delete spare[i]; }
+}
+
+int BoardQueue::next(MineBoard** board)
+{
+    MineBoard* fresh = NULL;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        restarts++;
+        if (!ready.empty()) {
+            fresh = ready.front();
+            ready.erase(ready.begin());
+            spare.push_back(*board);
+        }
+        else { empty++; }
+    }
+    if (fresh == NULL) {
+        (*board)->reset();
+        return 0;
+    }
+    wake.notify_one();
+    *board = fresh;
+    return 1;
+}
+
+void BoardQueue::resize(int width, int height, int num_mines_in)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_x = width, size_y = height, num_mines = num_mines_in;
+        generation++;
+        spare.insert(spare.end(), ready.begin(), ready.end());
+        ready.clear();
+    }
+    wake.notify_one();
+}
+
+void BoardQueue::worker_main()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (1) {
+        wake.wait(guard, [this] { return stop || (int)ready.size() < depth; });
+        if (stop) { return; }
+
+        MineBoard* board = NULL;
+        if (!spare.empty()) {
+            board = spare.back();
+            spare.pop_back();
+        }
+        int width = size_x, height = size_y, mines = num_mines, made_for = generation;
+
+        // The slow part runs unlocked, the caller can restart meanwhile
+        guard.unlock();
+        if (board == NULL) {
+            board = new MineBoard(width, height, mines);
+            // The constructor dealt without the index
+            if (index_openings) {
+                board->indexOpenings(1);
+                board->reset();
+            }
+        }
+        else {
+            if (board->getWidth() != width || board->getHeight() != height || board->numMines() != mines) {
+                board->resize(width, height, mines);
+            }
+            board->reset();
+        }
+        guard.lock();
+
+        if (made_for == generation) { ready.push_back(board); }
+        else { spare.push_back(board); }
+    }
+}
+
+#endif
@@ -0,0 +1,377 @@
+#ifndef FIXEDMINEBOARD_CPP
+#define FIXEDMINEBOARD_CPP
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+#include <MineBoard.cpp>
+
+// Board with its size and mine count fixed at compile time
+//
+// Same game and interface as MineBoard, for the standard sizes. The cells live
+// in a std::array inside the board, with a one square border all round that is
+// never covered and never a mine. The flood fill and the numbering read all 8
+// neighbours through constant offsets and let the border stop them, so neither
+// checks the board edges. Only squares coming in from the caller are bounds
+// checked, against constants.
+//
+// Mines are placed exactly as MineBoard places them, so a seed and safe square
+// give the same layout on either board and replays carry over. Square indices
+// (changedCells) are y*W + x as on MineBoard, the border is not visible outside.
+
+template <int W, int H, int M>
+class FixedMineBoard
+{
+    static_assert(W > 0 && H > 0, "board needs at least one square");
+    static_assert(M >= 0 && M <= W*H, "more mines than squares");
+
+    public:
+    // seed 0 picks one from the clock
+    FixedMineBoard(uint64_t seed = 0);
+    int is_mine(int x, int y);
+    void uncover_board();
+    void flag(int x, int y);
+    int sweep(int x, int y);
+    int chord(int x, int y);
+    size_t sweep_batch(const int* squares, size_t count);
+    int check_win() { return covered_safe == 0 && !mine_revealed; }
+    int check_lose() { return mine_revealed; }
+
+    static constexpr int getWidth() { return W; }
+    static constexpr int getHeight() { return H; }
+    int showSquare(int x, int y);
+
+    int numFlags() { return num_flags; }
+    static constexpr int numMines() { return M; }
+    GameStatus status();
+
+    const std::vector<size_t>& changedCells() { return changes; }
+    int allChanged() { return all_changed; }
+    void clearChanges() { changes.clear(); all_changed = 0; }
+
+    void reset() { reset(splitmix64(&seed_sequence), -1, -1); }
+    void reset(int safe_x, int safe_y) { reset(splitmix64(&seed_sequence), safe_x, safe_y); }
+    void reset(uint64_t seed, int safe_x = -1, int safe_y = -1);
+    void copy_layout(FixedMineBoard* other);
+    uint64_t getSeed() { return game_seed; }
+
+    private:
+    static constexpr int STRIDE = W + 2;
+    static constexpr int NUM_CELLS = STRIDE * (H + 2);
+    // Neighbours of a square as offsets into cells
+    static constexpr int NEIGHBOURS[8] = {
+        -STRIDE-1, -STRIDE, -STRIDE+1, -1, 1, STRIDE-1, STRIDE, STRIDE+1
+    };
+
+    static constexpr int check_bounds(int x, int y) { return (unsigned)x < (unsigned)W && (unsigned)y < (unsigned)H; }
+    static constexpr int pad(int x, int y) { return (y+1)*STRIDE + x+1; }
+    // Padded index back to y*W + x
+    static constexpr size_t unpad(int i) { return (size_t)((i/STRIDE - 1)*W + i%STRIDE - 1); }
+
+    int open_square(int i);
+    void flood_reveal();
+    void clear_state();
+    void place_mines(int safe_x, int safe_y);
+    void assign_numbers();
+
+    std::array<unsigned char, NUM_CELLS> cells;
+    // Every square is pushed at most once per sweep, so this never overflows
+    std::array<int, W*H> fill_stack;
+    int fill_top;
+    // Scratch for assign_numbers
+    std::array<unsigned char, NUM_CELLS> sums;
+    std::vector<size_t> changes;
+    int all_changed;
+    int num_flags;
+    int covered_safe;
+    int mine_revealed;
+    uint64_t seed_sequence;
+    uint64_t game_seed;
+    uint64_t rng[4];
+};
+
+typedef FixedMineBoard<9, 9, 10> BeginnerBoard;
+typedef FixedMineBoard<16, 16, 40> IntermediateBoard;
+typedef FixedMineBoard<30, 16, 99> ExpertBoard;
+
+template <int W, int H, int M>
+FixedMineBoard<W, H, M>::FixedMineBoard(uint64_t seed)
+{
+    if (seed == 0) {
+        seed = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(uintptr_t)this;
+    }
+    seed_sequence = seed;
+    // A whole board of changes, sweeps never allocate
+    changes.reserve(W*H);
+    reset();
+}
+
+template <int W, int H, int M>
+int FixedMineBoard<W, H, M>::is_mine(int x, int y)
+{
+    if (!check_bounds(x, y)) { return 0; }
+    return (cells[pad(x, y)] & CELL_MINE) != 0;
+}
+
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::uncover_board()
+{
+    for (int i=0; i<NUM_CELLS; i++) {
+        cells[i] &= ~(CELL_COVER | CELL_FLAG);
+    }
+    changes.clear();
+    all_changed = 1;
+}
+
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::flag(int x, int y)
+{
+    if (!check_bounds(x, y)) { return; }
+    unsigned char* cell = &cells[pad(x, y)];
+    if (!(*cell & CELL_COVER)) { return; }
+    if (*cell & CELL_FLAG) {
+        *cell &= ~CELL_FLAG;
+        num_flags--;
+    }
+    else {
+        *cell |= CELL_FLAG;
+        num_flags++;
+    }
+    changes.push_back((size_t)y*W + x);
+}
+
+// The border is uncovered, so it is skipped like any uncovered square
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::flood_reveal()
+{
+    int top = fill_top;
+    while (top > 0) {
+        int node = fill_stack[--top];
+        for (int k=0; k<8; k++) {
+            int n = node + NEIGHBOURS[k];
+            unsigned char adj = cells[n];
+            if ((adj & (CELL_COVER | CELL_FLAG)) != CELL_COVER) { continue; }
+            cells[n] = adj & ~CELL_COVER;
+            covered_safe--;
+            changes.push_back(unpad(n));
+            if ((adj & (CELL_MINE | CELL_ADJ_MASK)) == SAFE) {
+                fill_stack[top++] = n;
+            }
+        }
+    }
+}
+
+template <int W, int H, int M>
+int FixedMineBoard<W, H, M>::sweep(int x, int y)
+{
+    if (!check_bounds(x, y)) { return -1; }
+
+    int i = pad(x, y);
+    unsigned char cell = cells[i];
+    if (!(cell & CELL_COVER)) { return SAFE; }
+    if (cell & CELL_FLAG) { return FLAG; }
+    cells[i] = cell & ~CELL_COVER;
+    changes.push_back((size_t)y*W + x);
+
+    if (cell & CELL_MINE) {
+        mine_revealed = 1;
+        return MINE_VALUE;
+    }
+    covered_safe--;
+
+    if ((cell & CELL_ADJ_MASK) == SAFE) {
+        fill_stack[0] = i;
+        fill_top = 1;
+        flood_reveal();
+    }
+    return cell & CELL_ADJ_MASK;
+}
+
+template <int W, int H, int M>
+int FixedMineBoard<W, H, M>::open_square(int i)
+{
+    unsigned char cell = cells[i];
+    if ((cell & (CELL_COVER | CELL_FLAG)) != CELL_COVER) { return 0; }
+    cells[i] = cell & ~CELL_COVER;
+    changes.push_back(unpad(i));
+    if (cell & CELL_MINE) {
+        mine_revealed = 1;
+        return 1;
+    }
+    covered_safe--;
+    if ((cell & CELL_ADJ_MASK) == SAFE) {
+        fill_stack[fill_top++] = i;
+    }
+    return 0;
+}
+
+// Neighbours past the edge are border squares, never flagged nor covered
+template <int W, int H, int M>
+int FixedMineBoard<W, H, M>::chord(int x, int y)
+{
+    if (!check_bounds(x, y)) { return -1; }
+    int i = pad(x, y);
+    unsigned char cell = cells[i];
+    if (cell & (CELL_COVER | CELL_MINE)) { return SAFE; }
+
+    int k, flags = 0;
+    for (k=0; k<8; k++) {
+        flags += (cells[i + NEIGHBOURS[k]] & CELL_FLAG) >> 5;
+    }
+    if (flags != (cell & CELL_ADJ_MASK)) { return SAFE; }
+
+    int hit = 0;
+    fill_top = 0;
+    for (k=0; k<8; k++) {
+        hit |= open_square(i + NEIGHBOURS[k]);
+    }
+    flood_reveal();
+    return hit ? MINE_VALUE : SAFE;
+}
+
+template <int W, int H, int M>
+size_t FixedMineBoard<W, H, M>::sweep_batch(const int* squares, size_t count)
+{
+    size_t before = changes.size();
+    fill_top = 0;
+    for (size_t i=0; i<count; i++) {
+        int x = squares[2*i], y = squares[2*i+1];
+        if (check_bounds(x, y)) { open_square(pad(x, y)); }
+    }
+    flood_reveal();
+    return changes.size() - before;
+}
+
+template <int W, int H, int M>
+GameStatus FixedMineBoard<W, H, M>::status()
+{
+    if (mine_revealed) { return LOST; }
+    if (covered_safe == 0) { return WON; }
+    return PLAYING;
+}
+
+template <int W, int H, int M>
+int FixedMineBoard<W, H, M>::showSquare(int x, int y)
+{
+    if (!check_bounds(x, y)) { return COVER; }
+    unsigned char cell = cells[pad(x, y)];
+    if (cell & CELL_FLAG) { return FLAG; }
+    if (cell & CELL_COVER) { return COVER; }
+    if (cell & CELL_MINE) { return MINE_VALUE; }
+    return cell & CELL_ADJ_MASK;
+}
+
+// New board with no mine on (safe_x, safe_y), nor next to it when there is room
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::reset(uint64_t seed, int safe_x, int safe_y)
+{
+    game_seed = seed;
+    for (int i=0; i<4; i++) {
+        rng[i] = splitmix64(&seed);
+    }
+    cells.fill(0);
+    clear_state();
+    place_mines(safe_x, safe_y);
+    assign_numbers();
+}
+
+// MineBoard::place_mines over the padded cells, it must draw the same squares
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::place_mines(int safe_x, int safe_y)
+{
+    const size_t n = (size_t)W*H;
+
+    int safe_radius = 1;
+    if ((size_t)M + 9 > n) { safe_radius = 0; }
+    if ((size_t)M >= n || !check_bounds(safe_x, safe_y)) { safe_radius = -1; }
+
+    size_t excluded[9];
+    int num_excluded = 0;
+    for (int dy=-safe_radius; dy<=safe_radius; dy++) {
+        for (int dx=-safe_radius; dx<=safe_radius; dx++) {
+            if (check_bounds(safe_x+dx, safe_y+dy)) { excluded[num_excluded++] = (size_t)(safe_y+dy)*W + safe_x+dx; }
+        }
+    }
+    size_t allowed = n - num_excluded;
+
+    size_t remap_from[9], remap_to[9];
+    int num_remap = 0, i;
+    size_t tail = allowed;
+    for (i=0; i<num_excluded; i++) {
+        if (excluded[i] >= allowed) { continue; }
+        while (1) {
+            int taken = 0;
+            for (int k=0; k<num_excluded; k++) { taken |= excluded[k] == tail; }
+            if (!taken) { break; }
+            tail++;
+        }
+        remap_from[num_remap] = excluded[i];
+        remap_to[num_remap++] = tail++;
+    }
+
+    for (size_t j=allowed-M; j<allowed; j++) {
+        size_t pick = random_below(rng, j+1);
+        for (i=0; i<num_remap; i++) { if (pick == remap_from[i]) { pick = remap_to[i]; } }
+        unsigned char* cell = &cells[pad(pick % W, pick / W)];
+        if (*cell & CELL_MINE) {
+            pick = j;
+            for (i=0; i<num_remap; i++) { if (pick == remap_from[i]) { pick = remap_to[i]; } }
+            cell = &cells[pad(pick % W, pick / W)];
+        }
+        *cell |= CELL_MINE;
+    }
+}
+
+// Only mine bits are set when this runs, and the border has none. A mine is
+// 0x10 so a 3x3 block of them still fits a byte: sum each square with its left
+// and right neighbour, then those sums with the rows above and below, and take
+// the square itself back off. Both passes are straight byte loops of constant
+// length with no branches, which the compiler vectorises.
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::assign_numbers()
+{
+    int i;
+    // The loop can not sum the first and last cell, corners of the border
+    sums[0] = 0;
+    sums[NUM_CELLS-1] = 0;
+    for (i=1; i<NUM_CELLS-1; i++) {
+        sums[i] = cells[i-1] + cells[i] + cells[i+1];
+    }
+    // Runs over the border columns too, they are put back after
+    for (i=STRIDE; i<NUM_CELLS-STRIDE; i++) {
+        unsigned char mine = cells[i];
+        unsigned char count = (unsigned char)(sums[i-STRIDE] + sums[i] + sums[i+STRIDE] - mine) >> 4;
+        // mines keep an adjacency of 0
+        cells[i] = CELL_COVER | mine | (count & ((mine >> 4) - 1));
+    }
+    for (i=1; i<=H; i++) {
+        cells[i*STRIDE] = 0;
+        cells[i*STRIDE + STRIDE-1] = 0;
+    }
+}
+
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::copy_layout(FixedMineBoard* other)
+{
+    for (int y=0; y<H; y++) {
+        for (int x=0; x<W; x++) {
+            int i = pad(x, y);
+            cells[i] = (other->cells[i] & (CELL_MINE | CELL_ADJ_MASK)) | CELL_COVER;
+        }
+    }
+    game_seed = other->game_seed;
+    clear_state();
+}
+
+template <int W, int H, int M>
+void FixedMineBoard<W, H, M>::clear_state()
+{
+    num_flags = 0;
+    covered_safe = W*H - M;
+    mine_revealed = 0;
+    changes.clear();
+    all_changed = 1;
+}
+
+#endif
@@ -0,0 +1,344 @@
+#ifndef INFINITEMINEBOARD_CPP
+#define INFINITEMINEBOARD_CPP
+
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <MineBoard.cpp>
+
+// Board without edges
+//
+// Whether (x, y) holds a mine is a hash of (seed, x, y), so any square can be
+// asked about without storing anything. Play state lives in 64x64 chunks that
+// are only allocated when a square in them is swept, flagged or shown, and are
+// found through a hash map. Chunks nobody has uncovered or flagged anything in
+// can be rebuilt from the hash at any time; they sit on an LRU list and once
+// there are more than max_chunks the least recently used are dropped again.
+// Memory follows the explored area.
+//
+// Cells use the same packed layout as MineBoard and showSquare/sweep return the
+// same values. There is no winning, only LOST after sweeping a mine.
+
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+#define INFINITE_MAX_CHUNKS 1024
+// A single sweep reveals at most this many squares, the rest of a bigger
+// opening is left for expand(). Blank areas can be arbitrarily large.
+#define INFINITE_FLOOD_CAP (1 << 20)
+
+class InfiniteMineBoard
+{
+    public:
+    // density is the chance of a square being a mine, seed 0 picks one from the clock
+    InfiniteMineBoard(double density, uint64_t seed = 0, size_t max_chunks = INFINITE_MAX_CHUNKS);
+    ~InfiniteMineBoard();
+
+    int is_mine(int x, int y);
+    void flag(int x, int y);
+    // The first sweep of a game is never a mine, nor are its neighbours
+    int sweep(int x, int y);
+    int showSquare(int x, int y);
+    // Keep revealing an opening a sweep stopped at INFINITE_FLOOD_CAP, returns squares left queued
+    size_t expand(size_t budget = INFINITE_FLOOD_CAP);
+    size_t pendingReveal() { return fill_stack.size() / 2; }
+
+    GameStatus status() { return mine_revealed ? LOST : PLAYING; }
+    int numFlags() { return num_flags; }
+    size_t numRevealed() { return num_revealed; }
+    size_t numChunks() { return chunks.size(); }
+    size_t numEvicted() { return evicted; }
+
+    // Forget every chunk and start over, seed 0 draws the next seed from the sequence
+    void reset(uint64_t seed = 0);
+    uint64_t getSeed() { return game_seed; }
+
+    private:
+    struct Chunk
+    {
+        int cx, cy;
+        int touched;  // squares uncovered or flagged, 0 means it can be rebuilt
+        std::list<uint64_t>::iterator lru;  // valid while touched is 0
+        unsigned char cells[CHUNK_SIZE * CHUNK_SIZE];
+    };
+
+    static uint64_t key(int cx, int cy) { return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy; }
+    // Arithmetic shifts, so negative coordinates land in the chunk below them
+    static int chunk_of(int v) { return v >> CHUNK_SHIFT; }
+    static int offset(int x, int y) { return (y & CHUNK_MASK) * CHUNK_SIZE + (x & CHUNK_MASK); }
+
+    int hashed_mine(int x, int y);
+    unsigned char* cell(int x, int y);
+    Chunk* chunk(int cx, int cy);
+    void build(Chunk* c);
+    void evict(Chunk* keep);
+    void touch(Chunk* c, int delta);
+    void reveal(int x, int y, unsigned char* square, Chunk* c);
+
+    std::unordered_map<uint64_t, Chunk*> chunks;
+    std::list<uint64_t> lru;  // untouched chunks, most recently used first
+    Chunk* last;  // one entry lookup cache, flood fill mostly stays in a chunk
+    size_t max_chunks;
+    size_t evicted;
+
+    std::vector<int> fill_stack;  // x, y pairs
+    uint64_t threshold;  // hash below this is a mine
+    uint64_t seed_sequence;
+    uint64_t game_seed;
+    int started, start_x, start_y;
+    int num_flags;
+    size_t num_revealed;
+    int mine_revealed;
+};
+
+InfiniteMineBoard::InfiniteMineBoard(double density, uint64_t seed, size_t max_chunks_in)
+{
+    if (seed == 0) {
+        seed = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(uintptr_t)this;
+    }
+    seed_sequence = seed;
+    if (density < 0) { density = 0; }
+    threshold = density >= 1 ? UINT64_MAX : (uint64_t)(density * 18446744073709551616.0);
+    max_chunks = max_chunks_in > 0 ? max_chunks_in : 1;
+    last = NULL;
+    reset();
+}
+
+InfiniteMineBoard::~InfiniteMineBoard()
+{
+    std::unordered_map<uint64_t, Chunk*>::iterator it;
+    for (it = chunks.begin(); it != chunks.end(); ++it) {
+        delete it->second;
+    }
+}
+
+void InfiniteMineBoard::reset(uint64_t seed)
+{
+    std::unordered_map<uint64_t, Chunk*>::iterator it;
+    for (it = chunks.begin(); it != chunks.end(); ++it) {
+        delete it->second;
+    }
+    chunks.clear();
+    lru.clear();
+    last = NULL;
+    fill_stack.clear();
+
+    game_seed = seed != 0 ? seed : splitmix64(&seed_sequence);
+    started = 0;
+    num_flags = 0;
+    num_revealed = 0;
+    mine_revealed = 0;
+    evicted = 0;
+}
+
+// Pure function of the seed and the square, apart from the safe start area
+int InfiniteMineBoard::hashed_mine(int x, int y)
+{
+    if (started && x >= start_x-1 && x <= start_x+1 && y >= start_y-1 && y <= start_y+1) { return 0; }
+    uint64_t state = game_seed ^ ((uint64_t)(uint32_t)x << 32 | (uint32_t)y);
+    return splitmix64(&state) < threshold;
+}
+
+int InfiniteMineBoard::is_mine(int x, int y)
+{
+    return hashed_mine(x, y);
+}
+
+// Fill a fresh chunk from the hash: mines of the chunk and a one square ring
+// around it, then the neighbour counts
+void InfiniteMineBoard::build(Chunk* c)
+{
+    unsigned char mines[(CHUNK_SIZE+2) * (CHUNK_SIZE+2)];
+    int x0 = c->cx * CHUNK_SIZE - 1, y0 = c->cy * CHUNK_SIZE - 1;
+    int x, y;
+
+    for (y=0; y<CHUNK_SIZE+2; y++) {
+        for (x=0; x<CHUNK_SIZE+2; x++) {
+            mines[y*(CHUNK_SIZE+2) + x] = hashed_mine(x0+x, y0+y);
+        }
+    }
+    for (y=0; y<CHUNK_SIZE; y++) {
+        const unsigned char* above = &mines[y*(CHUNK_SIZE+2)];
+        const unsigned char* row = above + (CHUNK_SIZE+2);
+        const unsigned char* below = row + (CHUNK_SIZE+2);
+        for (x=0; x<CHUNK_SIZE; x++) {
+            int adj = above[x] + above[x+1] + above[x+2]
+                    + row[x] + row[x+2]
+                    + below[x] + below[x+1] + below[x+2];
+            c->cells[y*CHUNK_SIZE + x] = CELL_COVER | (row[x+1] ? CELL_MINE : 0) | adj;
+        }
+    }
+}
+
+// Drop untouched chunks from the cold end of the LRU list until we are back
+// under max_chunks, or only touched chunks and the one in use are left
+void InfiniteMineBoard::evict(Chunk* keep)
+{
+    while (chunks.size() > max_chunks && !lru.empty()) {
+        std::unordered_map<uint64_t, Chunk*>::iterator found = chunks.find(lru.back());
+        Chunk* c = found->second;
+        if (c == keep) { break; }
+        if (c == last) { last = NULL; }
+        lru.pop_back();
+        chunks.erase(found);
+        delete c;
+        evicted++;
+    }
+}
+
+// Chunks leave the LRU list while they hold play state, they can not be rebuilt
+void InfiniteMineBoard::touch(Chunk* c, int delta)
+{
+    if (c->touched == 0) { lru.erase(c->lru); }
+    c->touched += delta;
+    if (c->touched == 0) {
+        lru.push_front(key(c->cx, c->cy));
+        c->lru = lru.begin();
+    }
+}
+
+InfiniteMineBoard::Chunk* InfiniteMineBoard::chunk(int cx, int cy)
+{
+    // Every use moves an untouched chunk to the front, the cached one too
+    if (last != NULL && last->cx == cx && last->cy == cy) {
+        if (last->touched == 0) { lru.splice(lru.begin(), lru, last->lru); }
+        return last;
+    }
+
+    uint64_t k = key(cx, cy);
+    std::unordered_map<uint64_t, Chunk*>::iterator found = chunks.find(k);
+    Chunk* c;
+    if (found != chunks.end()) {
+        c = found->second;
+        if (c->touched == 0) { lru.splice(lru.begin(), lru, c->lru); }
+    }
+    else {
+        c = new Chunk;
+        c->cx = cx;
+        c->cy = cy;
+        c->touched = 0;
+        build(c);
+        lru.push_front(k);
+        c->lru = lru.begin();
+        chunks[k] = c;
+        evict(c);
+    }
+    last = c;
+    return c;
+}
+
+unsigned char* InfiniteMineBoard::cell(int x, int y)
+{
+    return &chunk(chunk_of(x), chunk_of(y))->cells[offset(x, y)];
+}
+
+void InfiniteMineBoard::reveal(int x, int y, unsigned char* square, Chunk* c)
+{
+    *square &= ~CELL_COVER;
+    touch(c, 1);
+    num_revealed++;
+    // blank squares keep spreading
+    if ((*square & (CELL_MINE | CELL_ADJ_MASK)) == SAFE) {
+        fill_stack.push_back(x);
+        fill_stack.push_back(y);
+    }
+}
+
+void InfiniteMineBoard::flag(int x, int y)
+{
+    Chunk* c = chunk(chunk_of(x), chunk_of(y));
+    unsigned char* square = &c->cells[offset(x, y)];
+    if (!(*square & CELL_COVER)) { return; }
+    if (*square & CELL_FLAG) {
+        *square &= ~CELL_FLAG;
+        touch(c, -1);
+        num_flags--;
+    }
+    else {
+        *square |= CELL_FLAG;
+        touch(c, 1);
+        num_flags++;
+    }
+}
+
+int InfiniteMineBoard::sweep(int x, int y)
+{
+    if (!started) {
+        // Keep the first square and its neighbours clear. Only chunks within
+        // two squares of the start can have been built with the old mines or
+        // numbers, rebuild them.
+        started = 1;
+        start_x = x, start_y = y;
+        int cx, cy;
+        for (cy = chunk_of(y-2); cy <= chunk_of(y+2); cy++) {
+            for (cx = chunk_of(x-2); cx <= chunk_of(x+2); cx++) {
+                std::unordered_map<uint64_t, Chunk*>::iterator found = chunks.find(key(cx, cy));
+                if (found == chunks.end()) { continue; }
+                Chunk* c = found->second;
+                if (c == last) { last = NULL; }
+                if (c->touched == 0) { lru.erase(c->lru); }
+                chunks.erase(found);
+                // flags placed before the first sweep are kept
+                if (c->touched) {
+                    Chunk* rebuilt = chunk(cx, cy);
+                    for (int i=0; i<CHUNK_SIZE*CHUNK_SIZE; i++) {
+                        rebuilt->cells[i] |= c->cells[i] & CELL_FLAG;
+                    }
+                    touch(rebuilt, c->touched);
+                }
+                delete c;
+            }
+        }
+    }
+
+    Chunk* c = chunk(chunk_of(x), chunk_of(y));
+    unsigned char* square = &c->cells[offset(x, y)];
+    if (!(*square & CELL_COVER)) { return SAFE; }
+    if (*square & CELL_FLAG) { return FLAG; }
+
+    if (*square & CELL_MINE) {
+        *square &= ~CELL_COVER;
+        touch(c, 1);
+        mine_revealed = 1;
+        return MINE_VALUE;
+    }
+    reveal(x, y, square, c);
+    expand();
+    return *square & CELL_ADJ_MASK;
+}
+
+// Stack based flood fill as in MineBoard, crossing into (and creating) chunks
+// as it goes. A square is uncovered as it is pushed, so each is pushed once.
+size_t InfiniteMineBoard::expand(size_t budget)
+{
+    size_t revealed = 0;
+    while (!fill_stack.empty() && revealed < budget) {
+        int ny = fill_stack.back(); fill_stack.pop_back();
+        int nx = fill_stack.back(); fill_stack.pop_back();
+
+        for (int sy=ny-1; sy<=ny+1; sy++) {
+            for (int sx=nx-1; sx<=nx+1; sx++) {
+                Chunk* c = chunk(chunk_of(sx), chunk_of(sy));
+                unsigned char* square = &c->cells[offset(sx, sy)];
+                // skip uncovered and flagged squares
+                if ((*square & (CELL_COVER | CELL_FLAG)) != CELL_COVER) { continue; }
+                reveal(sx, sy, square, c);
+                revealed++;
+            }
+        }
+    }
+    return fill_stack.size() / 2;
+}
+
+int InfiniteMineBoard::showSquare(int x, int y)
+{
+    unsigned char square = *cell(x, y);
+    if (square & CELL_FLAG) { return FLAG; }
+    if (square & CELL_COVER) { return COVER; }
+    if (square & CELL_MINE) { return MINE_VALUE; }
+    return square & CELL_ADJ_MASK;
+}
+
+#endif
@@ -1,22 +1,85 @@
+#ifndef MINEBOARD_CPP
+#define MINEBOARD_CPP
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <new>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #define FLAG 9
 #define COVER 10
 #define MINE_VALUE 11
 #define SAFE 0
 
+// Packed cell layout, one byte per cell
+// bits 0-3 number of adjacent mines (0-8)
+// bit 4    mine
+// bit 5    flag
+// bit 6    cover
+#define CELL_ADJ_MASK 0x0F
+#define CELL_MINE 0x10
+#define CELL_FLAG 0x20
+#define CELL_COVER 0x40
+
+enum GameStatus
+{
+    PLAYING, WON, LOST
+};
+
+#define OPENING_TOUCHED 0x80000000u
+
+// Board snapshot file: this header, then the packed cells row by row
+// (width*height bytes, same layout as in memory). Integers are native endian.
+#define SNAPSHOT_MAGIC 0x5057534Du  // "MSWP"
+#define SNAPSHOT_VERSION 1
+
+struct BoardSnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    int32_t size_x, size_y;
+    int32_t num_mines;
+    int32_t num_flags;
+    int32_t mine_revealed;
+    uint64_t covered_safe;
+    uint64_t seed_sequence;
+    uint64_t game_seed;
+    uint64_t rng[4];
+};
+
 class MineBoard
 {
     public:
-    MineBoard(int widith, int height, int num_mines_in);
+    // seed 0 picks one from the clock. Throws std::bad_alloc when the board
+    // does not fit in memory
+    MineBoard(int widith, int height, int num_mines_in, uint64_t seed = 0);
     ~MineBoard();
     int is_mine(int x, int y);
     void uncover_board();
     void flag(int x, int y);
     int sweep(int x, int y);
+    // Sweep the covered, unflagged neighbours of an uncovered number that has
+    // as many flags around it. Returns MINE_VALUE when a wrong flag let it
+    // uncover a mine, -1 off the board, otherwise SAFE (also when it did nothing)
+    int chord(int x, int y);
+    // Sweep count squares given as x,y pairs, with one flood fill over every
+    // opening they start. Ends the same as sweeping them one by one. Returns how
+    // many squares changed, they are the last that many entries of changedCells()
+    size_t sweep_batch(const int* squares, size_t count);
     int check_win();
     int check_lose();
 
@@ -26,18 +89,142 @@ class MineBoard
 
     int numFlags() { return num_flags; }
     int numMines() { return num_mines; }
+    GameStatus status();
 
+    // Squares whose shown value changed since the last clearChanges(),
+    // as indices y*width + x. Filled by sweep and flag, emptied by reset.
+    // allChanged() is set instead when reset or uncover_board touched every square.
+    const std::vector<size_t>& changedCells() { return changes; }
+    int allChanged() { return all_changed; }
+    void clearChanges() { changes.clear(); all_changed = 0; }
+
+    // The packed cells (CELL_* bits), width bytes a row with no padding.
+    // Stays put until resize grows the board or load replaces it
+    const unsigned char* cellData() { return cells; }
+
+    // reset() and reset(safe_x, safe_y) draw the next game seed from the board's
+    // own seed sequence, reset(seed) replays the game with that seed
     void reset();
+    void reset(int safe_x, int safe_y);
+    void reset(uint64_t seed, int safe_x = -1, int safe_y = -1);
+    void copy_layout(MineBoard* other);
+    // Change the size, the cells are only reallocated when they grow past
+    // what the board has held before. Call reset afterwards. Throws
+    // std::bad_alloc, with the board unchanged, when the new size does not fit
+    void resize(int width, int height, int num_mines_in);
+    uint64_t getSeed() { return game_seed; }
+
+    // Opening index: reset labels every opening (a connected blank region) and
+    // lists its squares together with its numbered rim, so sweeping a blank
+    // square uncovers that list instead of searching for it. Costs about 4 bytes
+    // a square plus 4 per listed square. Off by default, worth it where a layout
+    // is played out square by square. Takes effect at the next reset, turning
+    // it off frees it
+    void indexOpenings(int enabled);
+    // Openings on the current layout, -1 when there is no index (turned off,
+    // or the board was loaded since the last reset)
+    int numOpenings() { return openings_valid ? (int)opening_state.size() : -1; }
+    // Squares the k'th opening uncovers, rim included
+    size_t openingSize(int k) { return opening_start[k+1] - opening_start[k]; }
+
+    // Write the whole board state to path. Returns 0, or -1 with errno set
+    int save(const char* path);
+    // Replace this board with the snapshot at path, the size may change. The file
+    // is mapped copy-on-write and its cells are used where they are, so loading
+    // costs page faults rather than a read and parse. Returns 0, or -1 with
+    // errno set (EINVAL for a file that is not a snapshot or holds impossible
+    // cells) and the board unchanged. The mine, flag and covered counts are
+    // taken from the cells, not the header
+    int load(const char* path);
 
     private:
     int check_bounds(int x, int y);
-    int** board;
-    int** covered;
+    int open_square(size_t i);
+    void flood_reveal();
+    void label_openings();
+    void reveal_opening(uint32_t k);
+    void clear_state();
+    void assign_numbers();
+    void place_mines(int safe_x, int safe_y);
+    uint64_t* mine_word(int x, int y) { return &mine_rows[(size_t)(y+1)*((size_x+63)/64 + 2) + 1 + x/64]; }
+    size_t index(int x, int y) { return (size_t)y*size_x + x; }
+    unsigned char* cells;
+    size_t cell_capacity;
+    // Set when cells points into a loaded snapshot instead of our own allocation
+    void* mapping;
+    size_t mapping_size;
+    void release_cells();
+    // Scratch for flood fill, kept between sweeps so it only grows once
+    std::vector<size_t> fill_stack;
+    std::vector<size_t> changes;
+    int all_changed;
+    // Scratch for reset: mine layout as bit rows, padded by a zero row above and
+    // below and a zero word either side, and the 4 neighbour count planes of a row
+    std::vector<uint64_t> mine_rows;
+    std::vector<uint64_t> count_planes;
+    // Opening index. opening_label is 1 + the opening of each blank square (for
+    // numbers it is scratch); opening k lists opening_cells[opening_start[k] ..
+    // opening_start[k+1]). opening_state counts flagged blank squares of each
+    // opening, plus OPENING_TOUCHED once any of it was uncovered. The list is
+    // only used while the state is 0, otherwise the flood fill takes over, so
+    // flags and partly uncovered openings play out exactly as before.
+    int openings_enabled;
+    int openings_valid;
+    std::vector<uint32_t> opening_label;
+    std::vector<uint32_t> opening_start;
+    std::vector<uint32_t> opening_cells;
+    std::vector<uint32_t> opening_state;
     int size_x, size_y;
     int num_mines;
     int num_flags;  
+    // Running game state, kept up to date by sweep and reset
+    size_t covered_safe;  // covered squares that are not mines
+    int mine_revealed;
+    // Seeds, every board has its own so boards on different threads never share state
+    uint64_t seed_sequence;
+    uint64_t game_seed;
+    uint64_t rng[4];  // xoshiro256** state for the current game
 };
 
+// splitmix64, used to expand seeds
+static uint64_t splitmix64(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256**
+static inline uint64_t next_random(uint64_t* rng)
+{
+    uint64_t result = rng[1] * 5;
+    result = ((result << 7) | (result >> 57)) * 9;
+    uint64_t t = rng[1] << 17;
+    rng[2] ^= rng[0];
+    rng[3] ^= rng[1];
+    rng[1] ^= rng[2];
+    rng[0] ^= rng[3];
+    rng[2] ^= t;
+    rng[3] = (rng[3] << 45) | (rng[3] >> 19);
+    return result;
+}
+
+// Uniform in [0, bound) without modulo bias (Lemire's multiply and reject)
+static inline uint64_t random_below(uint64_t* rng, uint64_t bound)
+{
+    __uint128_t m = (__uint128_t)next_random(rng) * bound;
+    uint64_t low = (uint64_t)m;
+    if (low < bound) {
+        uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            m = (__uint128_t)next_random(rng) * bound;
+            low = (uint64_t)m;
+        }
+    }
+    return (uint64_t)(m >> 64);
+}
+
 
 int MineBoard::check_bounds(int x, int y)
 {
@@ -49,31 +236,65 @@ int MineBoard::check_bounds(int x, int y)
     );
 }
 
-MineBoard::MineBoard(int widith, int height, int num_mines_in)
+MineBoard::MineBoard(int widith, int height, int num_mines_in, uint64_t seed)
 {
-    srand(time(NULL));   // Initialization, should only be called once.
+    if (seed == 0) {
+        // Mix in the address too, so boards made in the same tick differ
+        seed = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(uintptr_t)this;
+    }
+    seed_sequence = seed;
     size_x = widith, size_y = height, num_mines = num_mines_in;
+    size_t n = (size_t)size_x*size_y;
+    if ((size_t)num_mines > n) { num_mines = (int)n; }
     num_flags = 0;
 
-    board = (int**) calloc(size_y, sizeof(int*));
-    covered = (int**) calloc(size_y, sizeof(int*));
-
-    for (int i=0; i< size_y; i++) {
-        board[i] = (int*) calloc(size_x, sizeof(int));
-        covered[i] = (int*) calloc(size_x, sizeof(int));
+    cells = (unsigned char*) calloc(n, sizeof(unsigned char));
+    if (cells == NULL) { throw std::bad_alloc(); }
+    cell_capacity = n;
+    mapping = NULL;
+    mapping_size = 0;
+    openings_enabled = 0;
+    openings_valid = 0;
+    // The destructor does not run for a constructor that throws
+    try {
+        reset();
+    }
+    catch (...) {
+        free(cells);
+        throw;
     }
-    reset();
 }
 
 MineBoard::~MineBoard() 
 {
     // Cross my T's
-    for (int i=0; i< size_y; i++) {
-        free(board[i]);
-        free(covered[i]);
+    release_cells();
+}
+
+void MineBoard::resize(int width, int height, int num_mines_in)
+{
+    size_t n = (size_t)width*height;
+    if (n > cell_capacity || mapping != NULL) {
+        // Allocate before letting go, a failure leaves the board as it was
+        unsigned char* grown = (unsigned char*) calloc(n, sizeof(unsigned char));
+        if (grown == NULL) { throw std::bad_alloc(); }
+        release_cells();
+        cells = grown;
+        cell_capacity = n;
     }
-    free(board);
-    free(covered);
+    size_x = width, size_y = height, num_mines = num_mines_in;
+    if ((size_t)num_mines > n) { num_mines = (int)n; }
+    openings_valid = 0;
+    changes.clear();
+    all_changed = 1;
+}
+
+void MineBoard::release_cells()
+{
+    if (mapping != NULL) { munmap(mapping, mapping_size); }
+    else { free(cells); }
+    mapping = NULL;
+    cells = NULL;
 }
 
 int MineBoard::is_mine(int x, int y) {
@@ -81,120 +302,187 @@ int MineBoard::is_mine(int x, int y) {
     if (y < 0) {return 0;}
     if (x >= size_x) {return 0;}
     if (y >= size_y) {return 0;}
-    return board[y][x] == MINE_VALUE;
+    return (cells[index(x,y)] & CELL_MINE) != 0;
 }
 
 void MineBoard::uncover_board()
 {
-    int x, y;
-    // Display Uncovered game board
-    for (x=0;x<size_x;x++){
-        for(y=0;y<size_y;y++){
-            covered[y][x] = 0;
-        }
-    }    
+    size_t i, n = (size_t)size_x*size_y;
+    // Display Uncovered game board, the game status is left as it was
+    for (i=0;i<n;i++){
+        cells[i] &= ~(CELL_COVER | CELL_FLAG);
+    }
+    changes.clear();
+    all_changed = 1;
 }
 
 void MineBoard::flag(int x, int y){
     if (!check_bounds(x,y)) {return;}
-    if (!covered[y][x]) {return;}  // Swept an uncovered place
-    else if (covered[y][x] == FLAG)  // Unflag
+    unsigned char* cell = &cells[index(x,y)];
+    if (!(*cell & CELL_COVER)) {return;}  // Swept an uncovered place
+    else if (*cell & CELL_FLAG)  // Unflag
     {
-        covered[y][x] = COVER;
+        *cell &= ~CELL_FLAG;
         num_flags--;
     }  
     else {
-        covered[y][x] = FLAG;
+        *cell |= CELL_FLAG;
         num_flags++;
     }
+    // A flagged blank square stops the flood fill part way, its opening can not use the list
+    if (openings_valid && (*cell & (CELL_MINE | CELL_ADJ_MASK)) == SAFE) {
+        uint32_t* state = &opening_state[opening_label[index(x,y)] - 1];
+        if (*cell & CELL_FLAG) { (*state)++; }
+        else { (*state)--; }
+    }
+    changes.push_back(index(x,y));
 }
 
-int MineBoard::sweep(int x, int y){
-    if (!check_bounds(x,y)) {return -1;}
-
-    if (!covered[y][x]) {return SAFE;}  // Swept an uncovered place
-    if (covered[y][x] == FLAG) {return FLAG;}  // Do not uncover it
-    covered[y][x] = 0;
+// Uncover the blank regions around the squares on fill_stack (already
+// uncovered) and their numbered rims. A cell is pushed at most once since it is
+// uncovered as it is pushed, so the cost is proportional to the revealed region
+// rather than the board, however many regions are filled at once.
+void MineBoard::flood_reveal()
+{
+    size_t node, n;
+    int nx, ny, sx, sy, x0, x1, y0, y1;
+    unsigned char adj;
 
-    if (board[y][x] == SAFE) {
-        int node,nx,ny,dx,dy,sx,sy;
-        int stack_height = 0;
-        int* stack = (int*) calloc(100, sizeof(int));
-        int* marked = (int*) calloc(100, sizeof(int));
+    while (!fill_stack.empty()) {
+        // take node off stack
+        node = fill_stack.back();
+        fill_stack.pop_back();
 
-        
-        for (sx=0;sx<size_x;sx++){
-            for(sy=0;sy<size_y;sy++){
-                if (covered[sy][sx] == 0) {marked[sx+size_x*sy] = 1;}
+        if (openings_valid) {
+            uint32_t k = opening_label[node] - 1;
+            if (opening_state[k] == 0) {
+                reveal_opening(k);
+                continue;
             }
+            opening_state[k] |= OPENING_TOUCHED;
         }
+        nx = node % size_x; ny = node / size_x;
 
-        stack[stack_height++] = x + (y*size_x); marked[x + (y*size_x)] = 1;
+        x0 = nx > 0 ? nx-1 : 0;
+        x1 = nx < size_x-1 ? nx+1 : nx;
+        y0 = ny > 0 ? ny-1 : 0;
+        y1 = ny < size_y-1 ? ny+1 : ny;
 
-        while (stack_height > 0) {
-            // take node off stack
-            node = stack[--stack_height];
-            nx = node % size_x; ny = node / size_x;
-            // uncover! (do action)
-            covered[ny][nx] = 0;
-            // get adjacent
-            for (dx=-1;dx <=1;dx++){
-                for (dy=-1;dy <=1;dy++){
-                    sy = ny+dy; sx = nx+dx;
-                    if (sy >= 0 && sx >= 0 && sy < size_y && sx < size_x){
-                        // check blank
-                        if (board[sy][sx] == SAFE) {
-                            // check unsearched
-                            if (marked[(size_x*sy) + sx] == 0) {
-                                stack[stack_height++] = sx + (sy*size_x); 
-                                marked[sx + (sy*size_x)] = 1;
-                            }
-                        }
-                        else if (board[sy][sx] != MINE_VALUE) {
-                            marked[sx + (sy*size_x)] = 1;
-                            covered[sy][sx] = 0;
-                        }
-                    }
+        // get adjacent
+        for (sy=y0;sy<=y1;sy++){
+            n = index(x0,sy);
+            for (sx=x0;sx<=x1;sx++,n++){
+                adj = cells[n];
+                // skip uncovered and flagged squares
+                if ((adj & (CELL_COVER | CELL_FLAG)) != CELL_COVER) {continue;}
+                cells[n] &= ~CELL_COVER;
+                covered_safe--;
+                changes.push_back(n);
+                // blank squares keep spreading
+                if ((adj & (CELL_MINE | CELL_ADJ_MASK)) == SAFE) {
+                    fill_stack.push_back(n);
                 }
             }
         }
-        free(stack);
-        free(marked);
-
     }
-    return board[y][x];
 }
 
-int MineBoard::check_win() {
-    int x, y;
-    int count = 0;
-    for (x=0;x<size_x;x++){
-        for(y=0;y<size_y;y++){
-            if (covered[y][x]) {
-                count++;
-                if (count > num_mines) {
-                    return 0;
-                }
-            }
-        }
+int MineBoard::sweep(int x, int y){
+    if (!check_bounds(x,y)) {return -1;}
+
+    unsigned char cell = cells[index(x,y)];
+    if (!(cell & CELL_COVER)) {return SAFE;}  // Swept an uncovered place
+    if (cell & CELL_FLAG) {return FLAG;}  // Do not uncover it
+    cells[index(x,y)] &= ~CELL_COVER;
+    changes.push_back(index(x,y));
+
+    if (cell & CELL_MINE) {
+        mine_revealed = 1;
+        return MINE_VALUE;
     }
-    return 1;
+    covered_safe--;
+
+    if ((cell & CELL_ADJ_MASK) == SAFE) {
+        fill_stack.clear();
+        fill_stack.push_back(index(x,y));
+        flood_reveal();
+    }
+    return cell & CELL_ADJ_MASK;
 }
 
-int MineBoard::check_lose() {
-    int x, y;
-    for (x=0;x<size_x;x++){
-        for(y=0;y<size_y;y++){
-            if (!covered[y][x]) {
-                if (board[y][x] == MINE_VALUE) {
-                    return 1;
-                }
-            }
-        }
+// Uncover a covered, unflagged square, blank ones are queued for flood_reveal.
+// Returns 1 when it uncovered a mine
+int MineBoard::open_square(size_t i)
+{
+    unsigned char cell = cells[i];
+    if ((cell & (CELL_COVER | CELL_FLAG)) != CELL_COVER) {return 0;}
+    cells[i] = cell & ~CELL_COVER;
+    changes.push_back(i);
+    if (cell & CELL_MINE) {
+        mine_revealed = 1;
+        return 1;
+    }
+    covered_safe--;
+    if ((cell & CELL_ADJ_MASK) == SAFE) {
+        fill_stack.push_back(i);
     }
     return 0;
 }
 
+int MineBoard::chord(int x, int y)
+{
+    if (!check_bounds(x,y)) {return -1;}
+    unsigned char cell = cells[index(x,y)];
+    if (cell & (CELL_COVER | CELL_MINE)) {return SAFE;}
+
+    int sx, sy, flags = 0;
+    int x0 = x > 0 ? x-1 : 0;
+    int x1 = x < size_x-1 ? x+1 : x;
+    int y0 = y > 0 ? y-1 : 0;
+    int y1 = y < size_y-1 ? y+1 : y;
+    for (sy=y0;sy<=y1;sy++){
+        for (sx=x0;sx<=x1;sx++){ flags += (cells[index(sx,sy)] & CELL_FLAG) != 0; }
+    }
+    if (flags != (cell & CELL_ADJ_MASK)) {return SAFE;}
+
+    int hit = 0;
+    fill_stack.clear();
+    for (sy=y0;sy<=y1;sy++){
+        for (sx=x0;sx<=x1;sx++){ hit |= open_square(index(sx,sy)); }
+    }
+    flood_reveal();
+    return hit ? MINE_VALUE : SAFE;
+}
+
+size_t MineBoard::sweep_batch(const int* squares, size_t count)
+{
+    size_t before = changes.size();
+    // Uncover every square first, then fill from all the blank ones together.
+    // A square inside an opening another one starts is skipped by open_square
+    // or by the fill, so no region is walked twice.
+    fill_stack.clear();
+    for (size_t i=0; i<count; i++) {
+        int x = squares[2*i], y = squares[2*i+1];
+        if (check_bounds(x,y)) { open_square(index(x,y)); }
+    }
+    flood_reveal();
+    return changes.size() - before;
+}
+
+int MineBoard::check_win() {
+    return covered_safe == 0 && !mine_revealed;
+}
+
+int MineBoard::check_lose() {
+    return mine_revealed;
+}
+
+GameStatus MineBoard::status() {
+    if (mine_revealed) { return LOST; }
+    if (covered_safe == 0) { return WON; }
+    return PLAYING;
+}
+
 int MineBoard::showSquare(int x, int y) 
 {
     if (!check_bounds(x,y)) {return COVER;}
@@ -203,51 +491,474 @@ int MineBoard::showSquare(int x, int y)
     // 9 flag
     // 10 cover
     // 11 for mine
-    if (covered[y][x] == FLAG) { return FLAG; }
-    if (covered[y][x] == COVER) { return COVER; }
-    return board[y][x];
+    unsigned char cell = cells[index(x,y)];
+    if (cell & CELL_FLAG) { return FLAG; }
+    if (cell & CELL_COVER) { return COVER; }
+    if (cell & CELL_MINE) { return MINE_VALUE; }
+    return cell & CELL_ADJ_MASK;
 }
 
 void MineBoard::reset() {
-    int i, x, y, dy, dx;
-    // Initialize the board & Cover Map
-    for (int y=0; y<size_y; y++) {
-        for (int x=0; x<size_x;x++) {
-            board[y][x] = SAFE;
-            covered[y][x] = COVER;
+    reset(splitmix64(&seed_sequence), -1, -1);
+}
+
+void MineBoard::reset(int safe_x, int safe_y) {
+    reset(splitmix64(&seed_sequence), safe_x, safe_y);
+}
+
+// New board with no mine on (safe_x, safe_y), nor next to it when there is room
+void MineBoard::reset(uint64_t seed, int safe_x, int safe_y) {
+    game_seed = seed;
+    for (int i=0; i<4; i++) {
+        rng[i] = splitmix64(&seed);
+    }
+
+    // Scratch is sized here rather than up front, a loaded board may never reset
+    mine_rows.resize((size_t)(size_y+2) * ((size_x+63)/64 + 2));
+    count_planes.resize(4 * ((size_x+63)/64));
+
+    // Lay the mines out as bit rows, assign_numbers then writes every cell
+    std::fill(mine_rows.begin(), mine_rows.end(), 0);
+    clear_state();
+    place_mines(safe_x, safe_y);
+    assign_numbers();
+    label_openings();
+}
+
+void MineBoard::indexOpenings(int enabled)
+{
+    openings_enabled = enabled;
+    if (!enabled) {
+        openings_valid = 0;
+        std::vector<uint32_t>().swap(opening_label);
+        std::vector<uint32_t>().swap(opening_start);
+        std::vector<uint32_t>().swap(opening_cells);
+        std::vector<uint32_t>().swap(opening_state);
+    }
+}
+
+// Label the openings of a fresh layout and list their squares.
+// The board is scanned in order and every blank square not labelled yet starts
+// a new opening, filled from there with the flood fill's stack. Each square
+// the fill reaches goes on the opening's list once: blank squares carry their
+// label, and numbers, which have no label, get the same value as a stamp so a
+// number bordering several openings is listed once in each. A blank square has
+// no mine next to it, so the fill never needs to look at the cell to tell.
+void MineBoard::label_openings()
+{
+    openings_valid = 0;
+    size_t n = (size_t)size_x*size_y;
+    if (!openings_enabled || n >= UINT32_MAX) {return;}
+
+    opening_label.assign(n, 0);
+    opening_start.clear();
+    opening_cells.clear();
+    uint32_t* labels = &opening_label[0];
+    int nx, ny, sx, sy, x0, x1, y0, y1;
+
+    for (size_t i=0; i<n; i++) {
+        if ((cells[i] & (CELL_MINE | CELL_ADJ_MASK)) != SAFE || labels[i] != 0) {continue;}
+        uint32_t label = (uint32_t)opening_start.size() + 1;
+        opening_start.push_back((uint32_t)opening_cells.size());
+        labels[i] = label;
+        opening_cells.push_back((uint32_t)i);
+        fill_stack.clear();
+        fill_stack.push_back(i);
+
+        while (!fill_stack.empty()) {
+            size_t node = fill_stack.back();
+            fill_stack.pop_back();
+            nx = node % size_x; ny = node / size_x;
+            x0 = nx > 0 ? nx-1 : 0;
+            x1 = nx < size_x-1 ? nx+1 : nx;
+            y0 = ny > 0 ? ny-1 : 0;
+            y1 = ny < size_y-1 ? ny+1 : ny;
+            for (sy=y0;sy<=y1;sy++){
+                size_t m = index(x0,sy);
+                for (sx=x0;sx<=x1;sx++,m++){
+                    if (labels[m] == label) {continue;}
+                    labels[m] = label;
+                    opening_cells.push_back((uint32_t)m);
+                    if ((cells[m] & CELL_ADJ_MASK) == SAFE) { fill_stack.push_back(m); }
+                }
+            }
+        }
+    }
+    opening_state.assign(opening_start.size(), 0);
+    opening_start.push_back((uint32_t)opening_cells.size());
+    openings_valid = 1;
+}
+
+// Uncover the listed squares of opening k that are still covered and not flagged,
+// what the flood fill would reach from any of its blank squares
+void MineBoard::reveal_opening(uint32_t k)
+{
+    opening_state[k] |= OPENING_TOUCHED;
+    const uint32_t* list = opening_cells.data();
+    for (uint32_t j=opening_start[k]; j<opening_start[k+1]; j++) {
+        uint32_t i = list[j];
+        if ((cells[i] & (CELL_COVER | CELL_FLAG)) != CELL_COVER) {continue;}
+        cells[i] &= ~CELL_COVER;
+        covered_safe--;
+        changes.push_back(i);
+    }
+}
+
+// Put the Mines down
+// Floyd's sampling picks num_mines distinct squares with one random number each,
+// so the cost is linear in the mine count whatever the density. The squares kept
+// clear around the safe square are swapped out of the sampled range by remapping
+// them onto the allowed squares at its end.
+void MineBoard::place_mines(int safe_x, int safe_y) {
+    size_t n = (size_t)size_x*size_y;
+
+    // How far around the safe square to keep clear
+    int safe_radius = 1;
+    if ((size_t)num_mines + 9 > n) { safe_radius = 0; }
+    if ((size_t)num_mines >= n || !check_bounds(safe_x, safe_y)) { safe_radius = -1; }
+
+    size_t excluded[9];
+    int num_excluded = 0;
+    for (int dy=-safe_radius; dy<=safe_radius; dy++) {
+        for (int dx=-safe_radius; dx<=safe_radius; dx++) {
+            if (check_bounds(safe_x+dx, safe_y+dy)) { excluded[num_excluded++] = index(safe_x+dx, safe_y+dy); }
         }
     }
+    size_t allowed = n - num_excluded;
 
-    // reset flags
+    // Excluded squares inside [0, allowed) stand in for allowed squares past it
+    size_t remap_from[9], remap_to[9];
+    int num_remap = 0, i;
+    size_t tail = allowed;
+    for (i=0; i<num_excluded; i++) {
+        if (excluded[i] >= allowed) { continue; }
+        while (1) {
+            int taken = 0;
+            for (int k=0; k<num_excluded; k++) { taken |= excluded[k] == tail; }
+            if (!taken) { break; }
+            tail++;
+        }
+        remap_from[num_remap] = excluded[i];
+        remap_to[num_remap++] = tail++;
+    }
+
+    for (size_t j=allowed-num_mines; j<allowed; j++) {
+        size_t pick = random_below(rng, j+1);
+        for (i=0; i<num_remap; i++) { if (pick == remap_from[i]) { pick = remap_to[i]; } }
+        uint64_t* word = mine_word(pick % size_x, pick / size_x);
+        uint64_t bit = 1ull << (pick % size_x % 64);
+        if (*word & bit) {
+            pick = j;
+            for (i=0; i<num_remap; i++) { if (pick == remap_from[i]) { pick = remap_to[i]; } }
+            word = mine_word(pick % size_x, pick / size_x);
+            bit = 1ull << (pick % size_x % 64);
+        }
+        *word |= bit;
+    }
+}
+
+// Take the mines of a board the same size, with every square covered again
+void MineBoard::copy_layout(MineBoard* other) {
+    size_t i, n = (size_t)size_x*size_y;
+    for (i=0;i<n;i++){
+        cells[i] = (other->cells[i] & (CELL_MINE | CELL_ADJ_MASK)) | CELL_COVER;
+    }
+    game_seed = other->game_seed;
+    clear_state();
+    label_openings();
+}
+
+// reset flags & game state
+void MineBoard::clear_state() {
     num_flags = 0;
+    covered_safe = (size_t)size_x*size_y - num_mines;
+    mine_revealed = 0;
+    changes.clear();
+    all_changed = 1;
+}
 
-    // Put the Mines down
-    for (i=0; i<num_mines; i++) {
-        x = rand() % size_x;
-        y = rand() % size_y;
-        while (board[y][x] == MINE_VALUE) {
-            x = rand() % size_x;
-            y = rand() % size_y;
+// Full adder over every bit lane, works on uint64_t and on AVX2 vectors alike
+template <typename T>
+static inline void full_add(T a, T b, T c, T* sum, T* carry)
+{
+    T ab = a ^ b;
+    *sum = ab ^ c;
+    *carry = (a & b) | (c & ab);
+}
+
+// Add up the eight neighbour planes into a 4 bit count (at most 8)
+// in = above left/centre/right, left, right, below left/centre/right
+template <typename T>
+static inline void add_neighbours(const T* in, T* bit0, T* bit1, T* bit2, T* bit3)
+{
+    T s1, c1, s2, c2, s3, c3, c4, t, c5, c6;
+    full_add(in[0], in[1], in[2], &s1, &c1);
+    full_add(in[5], in[6], in[7], &s2, &c2);
+    s3 = in[3] ^ in[4];
+    c3 = in[3] & in[4];
+    full_add(s1, s2, s3, bit0, &c4);
+    full_add(c1, c2, c3, &t, &c5);
+    *bit1 = t ^ c4;
+    c6 = t & c4;
+    *bit2 = c5 ^ c6;
+    *bit3 = c5 & c6;
+}
+
+// Neighbour counts of one row of mine bits, 64 squares per word. The rows are
+// padded with a zero word either side, so [-1] and [words] can be read.
+static void count_row(const uint64_t* above, const uint64_t* row, const uint64_t* below, int words,
+    uint64_t* bit0, uint64_t* bit1, uint64_t* bit2, uint64_t* bit3)
+{
+    const uint64_t* rows[3] = {above, row, below};
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i+4<=words; i+=4) {
+        __m256i in[9];
+        for (int r=0; r<3; r++) {
+            __m256i centre = _mm256_loadu_si256((const __m256i*)(rows[r]+i));
+            __m256i prev = _mm256_loadu_si256((const __m256i*)(rows[r]+i-1));
+            __m256i next = _mm256_loadu_si256((const __m256i*)(rows[r]+i+1));
+            // square x sees x-1 through a left shift and x+1 through a right shift
+            in[r*3] = _mm256_or_si256(_mm256_slli_epi64(centre, 1), _mm256_srli_epi64(prev, 63));
+            in[r*3+1] = centre;
+            in[r*3+2] = _mm256_or_si256(_mm256_srli_epi64(centre, 1), _mm256_slli_epi64(next, 63));
         }
-        board[y][x] = MINE_VALUE;
-    }
-
-    // Assign the Mine-Adjacency Numbers
-    int mine_count;
-    for (x=0;x<size_x;x++){
-        for (y=0;y<size_y;y++){
-            if (is_mine(x, y)) {}
-            else {
-                mine_count = 0;
-                for (dy=-1; dy<=1;dy++) {
-                    for (dx=-1; dx<=1;dx++) {
-                        if (is_mine(x+dx, y+dy)) {
-                            mine_count++;
-                        }
-                    }
-                }
-                board[y][x] = mine_count;
+        __m256i planes[8] = {in[0], in[1], in[2], in[3], in[5], in[6], in[7], in[8]};
+        __m256i b0, b1, b2, b3;
+        add_neighbours(planes, &b0, &b1, &b2, &b3);
+        _mm256_storeu_si256((__m256i*)(bit0+i), b0);
+        _mm256_storeu_si256((__m256i*)(bit1+i), b1);
+        _mm256_storeu_si256((__m256i*)(bit2+i), b2);
+        _mm256_storeu_si256((__m256i*)(bit3+i), b3);
+    }
+#endif
+
+    for (; i<words; i++) {
+        uint64_t in[9];
+        for (int r=0; r<3; r++) {
+            in[r*3] = (rows[r][i] << 1) | (rows[r][i-1] >> 63);
+            in[r*3+1] = rows[r][i];
+            in[r*3+2] = (rows[r][i] >> 1) | (rows[r][i+1] << 63);
+        }
+        uint64_t planes[8] = {in[0], in[1], in[2], in[3], in[5], in[6], in[7], in[8]};
+        add_neighbours(planes, &bit0[i], &bit1[i], &bit2[i], &bit3[i]);
+    }
+}
+
+// Low 8 bits of a plane as one 0/1 byte per bit
+static inline uint64_t spread_bits(uint64_t bits)
+{
+    uint64_t t = ((bits & 0xFF) * 0x0101010101010101ull) & 0x8040201008040201ull;
+    return ((t + 0x7F7F7F7F7F7F7F7Full) >> 7) & 0x0101010101010101ull;
+}
+
+// spread_bits of every byte value, looked up while writing cells out
+struct SpreadTable
+{
+    uint64_t bytes[256];
+    SpreadTable() { for (int i=0; i<256; i++) { bytes[i] = spread_bits(i); } }
+};
+static const SpreadTable spread_table;
+
+#if defined(__AVX2__)
+// 32 bits as 32 bytes, 0xFF where the bit is set
+static inline __m256i expand_bits(uint32_t bits)
+{
+    const __m256i pick = _mm256_setr_epi8(
+        0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1, 2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3);
+    const __m256i select = _mm256_set1_epi64x(0x8040201008040201ll);
+    __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32((int)bits), pick);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(spread, select), select);
+}
+#endif
+
+// Assign the Mine-Adjacency Numbers
+// Neighbour counts are worked out bit-sliced, 64 squares (256 with AVX2) at a
+// time, then written out as covered cells 8 at a time.
+void MineBoard::assign_numbers() {
+    int words = (size_x + 63) / 64;
+    int stride = words + 2;
+    uint64_t* planes = &count_planes[0];
+    int x, y, i;
+
+    for (y=0; y<size_y; y++) {
+        const uint64_t* row = &mine_rows[(size_t)(y+1)*stride + 1];
+        count_row(row - stride, row, row + stride, words,
+            planes, planes + words, planes + 2*words, planes + 3*words);
+
+        unsigned char* out = &cells[index(0,y)];
+        for (i=0; i<words; i++) {
+            uint64_t mines = row[i];
+            uint64_t b0 = planes[i], b1 = planes[words+i], b2 = planes[2*words+i], b3 = planes[3*words+i];
+            int count = size_x - i*64 < 64 ? size_x - i*64 : 64;
+            x = 0;
+#if defined(__AVX2__)
+            for (; x+32<=count; x+=32) {
+                __m256i mine_bytes = expand_bits((uint32_t)(mines >> x));
+                __m256i adj = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_and_si256(expand_bits((uint32_t)(b0 >> x)), _mm256_set1_epi8(1)),
+                        _mm256_and_si256(expand_bits((uint32_t)(b1 >> x)), _mm256_set1_epi8(2))),
+                    _mm256_or_si256(_mm256_and_si256(expand_bits((uint32_t)(b2 >> x)), _mm256_set1_epi8(4)),
+                        _mm256_and_si256(expand_bits((uint32_t)(b3 >> x)), _mm256_set1_epi8(8))));
+                __m256i packed = _mm256_or_si256(
+                    _mm256_andnot_si256(mine_bytes, adj),
+                    _mm256_or_si256(_mm256_and_si256(mine_bytes, _mm256_set1_epi8(CELL_MINE)), _mm256_set1_epi8(CELL_COVER)));
+                _mm256_storeu_si256((__m256i*)&out[i*64 + x], packed);
+            }
+#endif
+            for (; x+8<=count; x+=8) {
+                const uint64_t* spread = spread_table.bytes;
+                uint64_t mine_bytes = spread[(mines >> x) & 0xFF];
+                uint64_t adj = spread[(b0 >> x) & 0xFF] | (spread[(b1 >> x) & 0xFF] << 1)
+                    | (spread[(b2 >> x) & 0xFF] << 2) | (spread[(b3 >> x) & 0xFF] << 3);
+                // mines keep an adjacency of 0
+                adj &= ~(mine_bytes * CELL_ADJ_MASK);
+                uint64_t packed = adj | (mine_bytes * CELL_MINE) | (0x0101010101010101ull * CELL_COVER);
+                // byte k of packed is square x+k (little endian)
+                memcpy(&out[i*64 + x], &packed, 8);
+            }
+            for (; x<count; x++) {
+                unsigned char cell = CELL_COVER;
+                if ((mines >> x) & 1) { cell |= CELL_MINE; }
+                else { cell |= ((b0 >> x) & 1) | (((b1 >> x) & 1) << 1) | (((b2 >> x) & 1) << 2) | (((b3 >> x) & 1) << 3); }
+                out[i*64 + x] = cell;
             }
         }
     }
-}
\ No newline at end of file
+}
+
+int MineBoard::save(const char* path)
+{
+    BoardSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.header_size = sizeof(header);
+    header.size_x = size_x;
+    header.size_y = size_y;
+    header.num_mines = num_mines;
+    header.num_flags = num_flags;
+    header.mine_revealed = mine_revealed;
+    header.covered_safe = covered_safe;
+    header.seed_sequence = seed_sequence;
+    header.game_seed = game_seed;
+    memcpy(header.rng, rng, sizeof(rng));
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { return -1; }
+
+    // Header and cells go out in one writev. The kernel stops a single call
+    // at about 2GB, so bigger boards loop on what is left.
+    struct iovec parts[2];
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(header);
+    parts[1].iov_base = cells;
+    parts[1].iov_len = (size_t)size_x*size_y;
+    struct iovec* part = parts;
+    int left = 2;
+    while (left > 0) {
+        ssize_t written = writev(fd, part, left);
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        while (left > 0 && (size_t)written >= part->iov_len) {
+            written -= part->iov_len;
+            part++, left--;
+        }
+        if (left > 0) {
+            part->iov_base = (char*)part->iov_base + written;
+            part->iov_len -= written;
+        }
+    }
+    return close(fd);
+}
+
+int MineBoard::load(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return -1; }
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    size_t size = (size_t)info.st_size;
+    if (size < sizeof(BoardSnapshotHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Private mapping: playing on writes into our own copy of the touched pages, never the file
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { return -1; }
+
+    const BoardSnapshotHeader* header = (const BoardSnapshotHeader*)map;
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION
+        || header->header_size < sizeof(BoardSnapshotHeader) || header->header_size > size
+        || header->size_x <= 0 || header->size_y <= 0
+        || size - header->header_size != (size_t)header->size_x*header->size_y) {
+        munmap(map, size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The counters are recomputed from the cells rather than trusted, so a
+    // file that disagrees with itself can not be won early or never. Cells must
+    // be ones the engine makes (a flag only on a covered square, at most 8
+    // adjacent mines) and an uncovered mine needs a lost game or a won one that
+    // was uncovered at the end. This pass faults in every page of the cells.
+    const unsigned char* data = (const unsigned char*)map + header->header_size;
+    size_t n = (size_t)header->size_x*header->size_y;
+    size_t mines = 0, flags = 0, safe_left = 0, revealed = 0;
+    int bad = 0;
+    for (size_t i=0; i<n; i++) {
+        unsigned char cell = data[i];
+        bad |= (cell & ~(CELL_ADJ_MASK | CELL_MINE | CELL_FLAG | CELL_COVER)) != 0
+            || (cell & CELL_ADJ_MASK) > 8
+            || (cell & (CELL_FLAG | CELL_COVER)) == CELL_FLAG;
+        mines += (cell & CELL_MINE) != 0;
+        flags += (cell & CELL_FLAG) != 0;
+        safe_left += (cell & (CELL_MINE | CELL_COVER)) == CELL_COVER;
+        revealed += (cell & (CELL_MINE | CELL_COVER)) == CELL_MINE;
+    }
+    if (bad || (header->mine_revealed != 0 && header->mine_revealed != 1)
+        || (header->mine_revealed && revealed == 0)
+        || (!header->mine_revealed && revealed > 0 && safe_left > 0)) {
+        munmap(map, size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    release_cells();
+    mapping = map;
+    mapping_size = size;
+    cells = (unsigned char*)map + header->header_size;
+    cell_capacity = (size_t)header->size_x*header->size_y;
+
+    size_x = header->size_x;
+    size_y = header->size_y;
+    num_mines = (int)mines;
+    num_flags = (int)flags;
+    mine_revealed = header->mine_revealed;
+    covered_safe = safe_left;
+    seed_sequence = header->seed_sequence;
+    game_seed = header->game_seed;
+    memcpy(rng, header->rng, sizeof(rng));
+    // How much of each opening was uncovered is not in the file, the flood fill does
+    openings_valid = 0;
+
+    changes.clear();
+    all_changed = 1;
+    return 0;
+}
+
+#endif
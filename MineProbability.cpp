@@ -0,0 +1,417 @@
+#ifndef MINEPROBABILITY_CPP
+#define MINEPROBABILITY_CPP
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <MineBoard.cpp>
+
+// Exact mine probabilities
+//
+// Covered squares next to a revealed number (the frontier) are split into
+// independent components, squares linked by sharing a number. Each
+// component's valid mine layouts are enumerated on its own, counting layouts
+// per number of mines used, and large components are spread over threads.
+// The components are then combined with the squares no number touches (the
+// interior), weighting every total by C(interior, mines left - frontier mines).
+//
+// Flags count as mines, so mines left is numMines() - numFlags().
+
+// Components bigger than this, or that blow the search budget, fall back to
+// a local estimate and mark the result as inexact
+#define PROB_MAX_COMPONENT 48
+#define PROB_NODE_BUDGET (1 << 24)
+// Components smaller than this are enumerated on the calling thread
+#define PROB_THREAD_MIN 12
+
+#define PROB_NONE -1
+
+class MineProbability
+{
+    public:
+    MineProbability(int width, int height);
+
+    // Recompute the probability of every square, returns 1 if every component was exact
+    int compute(MineBoard* board);
+
+    // Chance the square is a mine, 0 for revealed squares and 1 for flags
+    double probability(int x, int y) { return prob[(size_t)y*size_x + x]; }
+    const double* probabilities() { return prob.data(); }
+
+    // Lowest probability covered square, returns 0 if there is none
+    int safest(MineBoard* board, int* x, int* y);
+
+    int numComponents() { return (int)components.size(); }
+    void setThreads(int count) { num_threads = count > 0 ? count : 1; }
+
+    private:
+    struct Constraint
+    {
+        int need;  // mines still to place among the cells
+        int count;
+        int cells[8];  // frontier indices
+    };
+
+    struct FrontierCell
+    {
+        size_t square;
+        int component;
+        int count;
+        int constraints[8];
+    };
+
+    struct Component
+    {
+        std::vector<int> cells;  // frontier indices in enumeration order
+        std::vector<int> constraints;
+        std::vector<double> layouts;  // layouts[k] number of layouts using k mines
+        std::vector<double> cell_layouts;  // cell_layouts[i*(n+1)+k] layouts with cell i a mine
+        int exact;
+    };
+
+    void build(MineBoard* board);
+    void enumerate(Component* comp, int max_mines);
+    void estimate(Component* comp);
+
+    int size_x, size_y;
+    int num_threads;
+    int mines_left;
+    long interior;
+
+    std::vector<double> prob;
+    std::vector<int> frontier_id;  // frontier index of a square or PROB_NONE
+    std::vector<FrontierCell> frontier;
+    std::vector<Constraint> constraints;
+    std::vector<Component> components;
+};
+
+MineProbability::MineProbability(int width, int height)
+{
+    size_x = width, size_y = height;
+    num_threads = (int)std::thread::hardware_concurrency();
+    if (num_threads < 1) { num_threads = 1; }
+    prob.resize((size_t)size_x*size_y);
+    frontier_id.assign((size_t)size_x*size_y, PROB_NONE);
+}
+
+// Collect the constraints and split the frontier into components
+void MineProbability::build(MineBoard* board)
+{
+    int x, y, dx, dy;
+    size_t i;
+
+    for (i=0; i<frontier.size(); i++) { frontier_id[frontier[i].square] = PROB_NONE; }
+    frontier.clear();
+    constraints.clear();
+    components.clear();
+
+    long covered = 0;
+    mines_left = board->numMines() - board->numFlags();
+
+    for (y=0; y<size_y; y++) {
+        for (x=0; x<size_x; x++) {
+            int value = board->showSquare(x, y);
+            if (value == COVER) { covered++; continue; }
+            if (value == FLAG || value == SAFE || value > 8) { continue; }
+
+            Constraint c;
+            c.need = value;
+            c.count = 0;
+            for (dy=-1; dy<=1; dy++) {
+                for (dx=-1; dx<=1; dx++) {
+                    int sx = x+dx, sy = y+dy;
+                    if (sx < 0 || sy < 0 || sx >= size_x || sy >= size_y) { continue; }
+                    int adj = board->showSquare(sx, sy);
+                    if (adj == FLAG) { c.need--; }
+                    else if (adj == COVER) {
+                        size_t n = (size_t)sy*size_x + sx;
+                        if (frontier_id[n] == PROB_NONE) {
+                            FrontierCell f;
+                            f.square = n;
+                            f.component = PROB_NONE;
+                            f.count = 0;
+                            frontier_id[n] = (int)frontier.size();
+                            frontier.push_back(f);
+                        }
+                        c.cells[c.count++] = frontier_id[n];
+                    }
+                }
+            }
+            if (c.count == 0) { continue; }
+
+            int id = (int)constraints.size();
+            for (int k=0; k<c.count; k++) {
+                FrontierCell* f = &frontier[c.cells[k]];
+                f->constraints[f->count++] = id;
+            }
+            constraints.push_back(c);
+        }
+    }
+    interior = covered - (long)frontier.size();
+
+    // Squares sharing a number form a component, laid out in breadth first
+    // order along the constraints so they close early in the search and prune
+    for (i=0; i<frontier.size(); i++) {
+        if (frontier[i].component != PROB_NONE) { continue; }
+        Component comp;
+        comp.exact = 1;
+        frontier[i].component = (int)components.size();
+        comp.cells.push_back((int)i);
+        for (size_t head=0; head<comp.cells.size(); head++) {
+            FrontierCell* f = &frontier[comp.cells[head]];
+            for (int k=0; k<f->count; k++) {
+                Constraint* c = &constraints[f->constraints[k]];
+                for (int j=0; j<c->count; j++) {
+                    FrontierCell* g = &frontier[c->cells[j]];
+                    if (g->component != PROB_NONE) { continue; }
+                    g->component = frontier[i].component;
+                    comp.cells.push_back(c->cells[j]);
+                }
+            }
+        }
+        components.push_back(comp);
+    }
+    for (i=0; i<constraints.size(); i++) {
+        components[frontier[constraints[i].cells[0]].component].constraints.push_back((int)i);
+    }
+}
+
+// Count every valid layout of a component, by number of mines
+void MineProbability::enumerate(Component* comp, int max_mines)
+{
+    int n = (int)comp->cells.size();
+    comp->layouts.assign(n+1, 0.0);
+    comp->cell_layouts.assign((size_t)n*(n+1), 0.0);
+    if (n > PROB_MAX_COMPONENT) { estimate(comp); return; }
+
+    // Local view of the constraints: mines placed so far and cells left to decide
+    int nc = (int)comp->constraints.size();
+    std::vector<int> placed(nc, 0), open(nc, 0), need(nc);
+    std::vector<std::vector<int> > cell_constraints(n);  // local constraint ids of each cell
+    for (int j=0; j<nc; j++) {
+        Constraint* c = &constraints[comp->constraints[j]];
+        need[j] = c->need;
+        open[j] = c->count;
+    }
+    for (int i=0; i<n; i++) {
+        FrontierCell* f = &frontier[comp->cells[i]];
+        for (int k=0; k<f->count; k++) {
+            // constraint ids of a component are listed in increasing order
+            std::vector<int>::iterator it = std::lower_bound(comp->constraints.begin(),
+                comp->constraints.end(), f->constraints[k]);
+            cell_constraints[i].push_back((int)(it - comp->constraints.begin()));
+        }
+    }
+
+    std::vector<char> mine(n, 0);
+    std::vector<char> tried(n, 0);  // 0 untried, 1 tried safe, 2 tried both
+    long nodes = 0;
+    int depth = 0, mines = 0;
+
+    // Iterative depth first search, each cell is tried safe then mine
+    while (depth >= 0) {
+        if (depth == n) {
+            comp->layouts[mines] += 1.0;
+            for (int i=0; i<n; i++) {
+                if (mine[i]) { comp->cell_layouts[(size_t)i*(n+1) + mines] += 1.0; }
+            }
+            depth--;
+            continue;
+        }
+        if (++nodes > PROB_NODE_BUDGET) { estimate(comp); return; }
+
+        // Undo the previous choice at this depth
+        if (tried[depth]) {
+            for (size_t k=0; k<cell_constraints[depth].size(); k++) {
+                int j = cell_constraints[depth][k];
+                open[j]++;
+                if (mine[depth]) { placed[j]--; }
+            }
+            if (mine[depth]) { mines--; }
+        }
+        if (tried[depth] == 2) {
+            tried[depth] = 0;
+            mine[depth] = 0;
+            depth--;
+            continue;
+        }
+
+        mine[depth] = tried[depth] == 1;
+        tried[depth]++;
+        if (mine[depth]) { mines++; }
+
+        int ok = mines <= max_mines;
+        for (size_t k=0; k<cell_constraints[depth].size(); k++) {
+            int j = cell_constraints[depth][k];
+            open[j]--;
+            if (mine[depth]) { placed[j]++; }
+            if (placed[j] > need[j] || placed[j] + open[j] < need[j]) { ok = 0; }
+        }
+        if (ok) { depth++; }
+    }
+}
+
+// Fallback for components too big to enumerate: every cell gets the average
+// density of its numbers, spread as if the component held that many mines
+void MineProbability::estimate(Component* comp)
+{
+    int n = (int)comp->cells.size();
+    comp->exact = 0;
+    comp->layouts.assign(n+1, 0.0);
+    comp->cell_layouts.assign((size_t)n*(n+1), 0.0);
+
+    double total = 0;
+    std::vector<double> local(n);
+    for (int i=0; i<n; i++) {
+        FrontierCell* f = &frontier[comp->cells[i]];
+        double p = 0;
+        for (int k=0; k<f->count; k++) {
+            Constraint* c = &constraints[f->constraints[k]];
+            p += c->need / (double)c->count;
+        }
+        local[i] = p / f->count;
+        total += local[i];
+    }
+    int k = (int)(total + 0.5);
+    if (k > n) { k = n; }
+    comp->layouts[k] = 1.0;
+    for (int i=0; i<n; i++) { comp->cell_layouts[(size_t)i*(n+1) + k] = local[i]; }
+}
+
+// Polynomial product, trimmed to max_mines
+static void convolve(const std::vector<double>& a, const std::vector<double>& b,
+    std::vector<double>* out, int max_mines)
+{
+    size_t len = a.size() + b.size() - 1;
+    if ((int)len > max_mines + 1) { len = max_mines + 1; }
+    out->assign(len, 0.0);
+    for (size_t i=0; i<a.size() && i<len; i++) {
+        if (a[i] == 0) { continue; }
+        for (size_t j=0; j<b.size() && i+j<len; j++) {
+            (*out)[i+j] += a[i] * b[j];
+        }
+    }
+    // Rescale, only the ratios matter and the products can overflow
+    double top = 0;
+    for (size_t i=0; i<len; i++) { if ((*out)[i] > top) { top = (*out)[i]; } }
+    if (top > 0) { for (size_t i=0; i<len; i++) { (*out)[i] /= top; } }
+}
+
+static double log_choose(long n, long k)
+{
+    if (k < 0 || k > n) { return -INFINITY; }
+    return lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0);
+}
+
+int MineProbability::compute(MineBoard* board)
+{
+    size_t i;
+    build(board);
+    int max_mines = mines_left < 0 ? 0 : mines_left;
+
+    // Enumerate, big components spread over threads
+    std::vector<int> big;
+    for (i=0; i<components.size(); i++) {
+        if ((int)components[i].cells.size() >= PROB_THREAD_MIN) { big.push_back((int)i); }
+        else { enumerate(&components[i], max_mines); }
+    }
+    int workers = (int)big.size() < num_threads ? (int)big.size() : num_threads;
+    if (workers > 1) {
+        std::atomic<int> next(0);
+        std::vector<std::thread> pool;
+        for (int t=0; t<workers; t++) {
+            pool.push_back(std::thread([&]() {
+                int k;
+                while ((k = next++) < (int)big.size()) { enumerate(&components[big[k]], max_mines); }
+            }));
+        }
+        for (int t=0; t<workers; t++) { pool[t].join(); }
+    }
+    else {
+        for (size_t k=0; k<big.size(); k++) { enumerate(&components[big[k]], max_mines); }
+    }
+
+    // Prefix and suffix products, so each component can see the others
+    int nc = (int)components.size();
+    std::vector<std::vector<double> > prefix(nc+1), suffix(nc+1);
+    prefix[0].assign(1, 1.0);
+    suffix[nc].assign(1, 1.0);
+    for (int c=0; c<nc; c++) { convolve(prefix[c], components[c].layouts, &prefix[c+1], max_mines); }
+    for (int c=nc-1; c>=0; c--) { convolve(suffix[c+1], components[c].layouts, &suffix[c], max_mines); }
+
+    // Interior weight for each frontier total, relative to the largest
+    std::vector<double> weight(max_mines+1);
+    double top = -INFINITY;
+    for (int k=0; k<=max_mines; k++) {
+        weight[k] = log_choose(interior, mines_left - k);
+        if (weight[k] > top) { top = weight[k]; }
+    }
+    for (int k=0; k<=max_mines; k++) { weight[k] = top == -INFINITY ? 0 : exp(weight[k] - top); }
+
+    const std::vector<double>& all = prefix[nc];
+    double total = 0, interior_mines = 0;
+    for (size_t k=0; k<all.size(); k++) {
+        total += all[k] * weight[k];
+        interior_mines += all[k] * weight[k] * (mines_left - (double)k);
+    }
+
+    // Revealed squares and flags first
+    for (int y=0; y<size_y; y++) {
+        for (int x=0; x<size_x; x++) {
+            int value = board->showSquare(x, y);
+            double p = 0;
+            if (value == FLAG || value == MINE_VALUE) { p = 1; }
+            else if (value == COVER) { p = interior > 0 && total > 0 ? interior_mines / total / interior : 0; }
+            prob[(size_t)y*size_x + x] = p;
+        }
+    }
+
+    int exact = 1;
+    std::vector<double> others, tail;
+    for (int c=0; c<nc; c++) {
+        Component* comp = &components[c];
+        int n = (int)comp->cells.size();
+        exact &= comp->exact;
+        convolve(prefix[c], suffix[c+1], &others, max_mines);
+
+        // tail[k] total weight of the rest of the board when this component holds k mines
+        tail.assign(n+1, 0.0);
+        for (int k=0; k<=n && k<=max_mines; k++) {
+            for (size_t j=0; j<others.size() && k+(int)j<=max_mines; j++) {
+                tail[k] += others[j] * weight[k+j];
+            }
+        }
+        double comp_total = 0;
+        for (int k=0; k<=n; k++) { comp_total += comp->layouts[k] * tail[k]; }
+
+        for (int i=0; i<n; i++) {
+            double p = 0;
+            for (int k=0; k<=n; k++) { p += comp->cell_layouts[(size_t)i*(n+1) + k] * tail[k]; }
+            prob[frontier[comp->cells[i]].square] = comp_total > 0 ? p / comp_total : 0;
+        }
+    }
+    return exact;
+}
+
+int MineProbability::safest(MineBoard* board, int* x, int* y)
+{
+    double best = 2;
+    int sx, sy;
+    for (sy=0; sy<size_y; sy++) {
+        for (sx=0; sx<size_x; sx++) {
+            if (board->showSquare(sx, sy) != COVER) { continue; }
+            double p = prob[(size_t)sy*size_x + sx];
+            if (p < best) {
+                best = p;
+                *x = sx;
+                *y = sy;
+            }
+        }
+    }
+    return best <= 1;
+}
+
+#endif
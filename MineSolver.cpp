@@ -0,0 +1,297 @@
+#ifndef MINESOLVER_CPP
+#define MINESOLVER_CPP
+
+#include <stdint.h>
+#include <vector>
+
+#include <MineBoard.cpp>
+
+// Deterministic constraint solver
+//
+// Every revealed number is a constraint: its unknown neighbours hold exactly
+// (number - known mine neighbours) mines. The solver applies the single point
+// rules (no mines left / every unknown is a mine) and the pairwise subset rules
+// between numbers up to two squares apart.
+//
+// A constraint's unknown neighbours are kept as a 64 bit mask over an 8x8
+// window centred on the number, so comparing two constraints is a shift and a
+// couple of AND/ANDNOTs. Board wide state (revealed, known safe, known mine,
+// frontier) is kept in bitsets.
+//
+// The solver is incremental: feed it the squares a move changed with update()
+// and it only revisits the constraints around them.
+
+#define WINDOW_ORIGIN 3  // a number sits at (3,3) of its window
+#define WINDOW_STRIDE 8
+
+class MineSolver
+{
+    public:
+    MineSolver(int width, int height);
+
+    // Forget everything, call on a new game
+    void reset();
+    // Feed squares (y*width + x) whose shown value changed
+    void update(MineBoard* board, const size_t* changed, size_t count);
+    void update(MineBoard* board);  // consumes board->changedCells()
+    // Rebuild from every revealed square of the board
+    void solve(MineBoard* board);
+
+    int isSafe(int x, int y) { return check_bounds(x,y) && test(known_safe, index(x,y)); }
+    int isMine(int x, int y) { return check_bounds(x,y) && test(known_mine, index(x,y)); }
+    int isFrontier(int x, int y) { return check_bounds(x,y) && test(frontier, index(x,y)); }
+    int isUnknown(int x, int y) { return check_bounds(x,y) && is_unknown(index(x,y)); }
+
+    // Pops a deduced safe square that is still covered, returns 0 when there are none
+    int nextSafe(int* x, int* y);
+
+    int numKnownSafe() { return known_safe_count; }
+    int numKnownMines() { return known_mine_count; }
+
+    private:
+    int check_bounds(int x, int y) { return x >= 0 && x < size_x && y >= 0 && y < size_y; }
+    size_t index(int x, int y) { return (size_t)y*size_x + x; }
+
+    static int test(const std::vector<uint64_t>& bits, size_t i) { return (bits[i >> 6] >> (i & 63)) & 1; }
+    static void set(std::vector<uint64_t>& bits, size_t i) { bits[i >> 6] |= 1ull << (i & 63); }
+    static void clear(std::vector<uint64_t>& bits, size_t i) { bits[i >> 6] &= ~(1ull << (i & 63)); }
+
+    int is_unknown(size_t i) { return !test(revealed, i) && !test(known_safe, i) && !test(known_mine, i); }
+
+    void reveal(MineBoard* board, size_t i);
+    void enqueue(size_t i);
+    void enqueue_around(int x, int y);
+    uint64_t constraint(int x, int y, int* mines_left);
+    void mark(int x, int y, uint64_t mask, int mine);
+    void process(int x, int y);
+
+    int size_x, size_y;
+    std::vector<uint64_t> revealed;
+    std::vector<uint64_t> known_safe;
+    std::vector<uint64_t> known_mine;
+    std::vector<uint64_t> frontier;
+    std::vector<uint64_t> queued;
+    std::vector<unsigned char> number;  // value of revealed squares
+
+    std::vector<size_t> worklist;
+    std::vector<size_t> safe_list;
+    int known_safe_count;
+    int known_mine_count;
+};
+
+MineSolver::MineSolver(int width, int height)
+{
+    size_x = width, size_y = height;
+    size_t words = ((size_t)size_x*size_y + 63) / 64;
+    revealed.resize(words);
+    known_safe.resize(words);
+    known_mine.resize(words);
+    frontier.resize(words);
+    queued.resize(words);
+    number.resize((size_t)size_x*size_y);
+    reset();
+}
+
+void MineSolver::reset()
+{
+    std::fill(revealed.begin(), revealed.end(), 0);
+    std::fill(known_safe.begin(), known_safe.end(), 0);
+    std::fill(known_mine.begin(), known_mine.end(), 0);
+    std::fill(frontier.begin(), frontier.end(), 0);
+    std::fill(queued.begin(), queued.end(), 0);
+    worklist.clear();
+    safe_list.clear();
+    known_safe_count = 0;
+    known_mine_count = 0;
+}
+
+void MineSolver::enqueue(size_t i)
+{
+    if (!test(revealed, i) || test(queued, i) || number[i] == SAFE) { return; }
+    set(queued, i);
+    worklist.push_back(i);
+}
+
+// Queue every revealed number next to (x,y), their constraints just changed
+void MineSolver::enqueue_around(int x, int y)
+{
+    int dx, dy;
+    for (dy=-1; dy<=1; dy++) {
+        for (dx=-1; dx<=1; dx++) {
+            if (check_bounds(x+dx, y+dy)) { enqueue(index(x+dx, y+dy)); }
+        }
+    }
+}
+
+void MineSolver::reveal(MineBoard* board, size_t i)
+{
+    int x = i % size_x, y = i / size_x;
+    int value = board->showSquare(x, y);
+    // Covered, flagged or a revealed mine, nothing to learn
+    if (value > 8 || test(revealed, i)) { return; }
+
+    set(revealed, i);
+    clear(frontier, i);
+    if (test(known_safe, i)) {
+        clear(known_safe, i);
+        known_safe_count--;
+    }
+    number[i] = value;
+
+    int dx, dy;
+    for (dy=-1; dy<=1; dy++) {
+        for (dx=-1; dx<=1; dx++) {
+            if (!check_bounds(x+dx, y+dy)) { continue; }
+            size_t n = index(x+dx, y+dy);
+            if (value != SAFE && is_unknown(n)) { set(frontier, n); }
+            enqueue(n);
+        }
+    }
+}
+
+// Unknown neighbours of the number at (x,y) as a window mask,
+// and how many mines are still to be found among them
+uint64_t MineSolver::constraint(int x, int y, int* mines_left)
+{
+    uint64_t mask = 0;
+    int mines = number[index(x,y)];
+    int dx, dy;
+    for (dy=-1; dy<=1; dy++) {
+        for (dx=-1; dx<=1; dx++) {
+            if (!check_bounds(x+dx, y+dy)) { continue; }
+            size_t n = index(x+dx, y+dy);
+            if (test(known_mine, n)) { mines--; }
+            else if (is_unknown(n)) {
+                mask |= 1ull << ((WINDOW_ORIGIN+dx) + WINDOW_STRIDE*(WINDOW_ORIGIN+dy));
+            }
+        }
+    }
+    *mines_left = mines;
+    return mask;
+}
+
+// Mark every square of a window mask around (x,y) as a mine or as safe
+void MineSolver::mark(int x, int y, uint64_t mask, int mine)
+{
+    while (mask) {
+        int bit = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        int sx = x + (bit % WINDOW_STRIDE) - WINDOW_ORIGIN;
+        int sy = y + (bit / WINDOW_STRIDE) - WINDOW_ORIGIN;
+        size_t n = index(sx, sy);
+        if (!is_unknown(n)) { continue; }
+
+        clear(frontier, n);
+        if (mine) {
+            set(known_mine, n);
+            known_mine_count++;
+        }
+        else {
+            set(known_safe, n);
+            known_safe_count++;
+            safe_list.push_back(n);
+        }
+        enqueue_around(sx, sy);
+    }
+}
+
+void MineSolver::process(int x, int y)
+{
+    int mines_a, mines_b;
+    uint64_t a = constraint(x, y, &mines_a);
+    if (!a) { return; }
+
+    // Single point rules
+    int unknown_a = __builtin_popcountll(a);
+    if (mines_a == 0) { mark(x, y, a, 0); return; }
+    if (mines_a == unknown_a) { mark(x, y, a, 1); return; }
+
+    // Pairwise rules against every number that can share a square with this one
+    int dx, dy;
+    for (dy=-2; dy<=2; dy++) {
+        for (dx=-2; dx<=2; dx++) {
+            if ((dx == 0 && dy == 0) || !check_bounds(x+dx, y+dy)) { continue; }
+            size_t n = index(x+dx, y+dy);
+            if (!test(revealed, n) || number[n] == SAFE) { continue; }
+
+            // Move B's window into A's frame, both windows have room for a 2 square offset
+            uint64_t b = constraint(x+dx, y+dy, &mines_b);
+            int shift = dx + WINDOW_STRIDE*dy;
+            b = shift >= 0 ? b << shift : b >> -shift;
+            if (!(a & b)) { continue; }
+
+            uint64_t only_a = a & ~b;
+            uint64_t only_b = b & ~a;
+            if (!only_a && !only_b) { continue; }
+            int count_a = __builtin_popcountll(only_a);
+            int count_b = __builtin_popcountll(only_b);
+
+            // The shared squares hold at most mines_b mines,
+            // so the squares only A sees hold at least mines_a - mines_b
+            if (mines_a - mines_b == count_a) {
+                // every square only A sees is a mine, and the ones only B sees are safe
+                mark(x, y, only_a, 1);
+                mark(x, y, only_b, 0);
+            }
+            else if (mines_b - mines_a == count_b) {
+                mark(x, y, only_b, 1);
+                mark(x, y, only_a, 0);
+            }
+            // Subset rules, the difference holds exactly the difference in mines
+            else if (!only_b && mines_a == mines_b) { mark(x, y, only_a, 0); }
+            else if (!only_a && mines_a == mines_b) { mark(x, y, only_b, 0); }
+            else { continue; }
+
+            // A changed, come back to it for the remaining pairs
+            enqueue(index(x,y));
+            return;
+        }
+    }
+}
+
+void MineSolver::update(MineBoard* board, const size_t* changed, size_t count)
+{
+    size_t i;
+    for (i=0; i<count; i++) {
+        reveal(board, changed[i]);
+    }
+
+    while (!worklist.empty()) {
+        size_t n = worklist.back();
+        worklist.pop_back();
+        clear(queued, n);
+        process(n % size_x, n / size_x);
+    }
+}
+
+void MineSolver::update(MineBoard* board)
+{
+    const std::vector<size_t>& changed = board->changedCells();
+    update(board, changed.data(), changed.size());
+    board->clearChanges();
+}
+
+void MineSolver::solve(MineBoard* board)
+{
+    reset();
+    size_t i, n = (size_t)size_x*size_y;
+    for (i=0; i<n; i++) {
+        reveal(board, i);
+    }
+    update(board, NULL, 0);
+}
+
+int MineSolver::nextSafe(int* x, int* y)
+{
+    while (!safe_list.empty()) {
+        size_t n = safe_list.back();
+        safe_list.pop_back();
+        if (test(revealed, n)) { continue; }
+        *x = n % size_x;
+        *y = n / size_x;
+        return 1;
+    }
+    return 0;
+}
+
+#endif
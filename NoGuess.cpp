@@ -0,0 +1,123 @@
+#ifndef NOGUESS_CPP
+#define NOGUESS_CPP
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <MineBoard.cpp>
+#include <MineSolver.cpp>
+
+// No-guess board generation
+//
+// Candidate boards with a safe first click are generated and played out with
+// the constraint solver. The first candidate the solver clears without ever
+// guessing wins; candidates are raced across threads. If nothing passes within
+// the latency budget the board falls back to a plain safe-start board.
+
+#define NOGUESS_BUDGET_MS 50
+
+class NoGuessGenerator
+{
+    public:
+    // threads 0 uses every core
+    NoGuessGenerator(int width, int height, int num_mines, int threads = 0);
+    ~NoGuessGenerator();
+
+    // Reset board to a layout that can be cleared from (x, y) without guessing.
+    // Returns 1 on success, 0 if the budget ran out and it fell back to reset(x, y)
+    int generate(MineBoard* board, int x, int y, int budget_ms = NOGUESS_BUDGET_MS);
+
+    long numCandidates() { return candidates_tried; }
+    long numFallbacks() { return fallbacks; }
+
+    private:
+    void race(int worker, int x, int y, std::chrono::steady_clock::time_point deadline);
+
+    int num_workers;
+    std::vector<MineBoard*> candidates;
+    std::vector<MineSolver*> solvers;
+    std::atomic<int> winner;
+    std::atomic<long> tried;
+    long candidates_tried;
+    long fallbacks;
+};
+
+NoGuessGenerator::NoGuessGenerator(int width, int height, int num_mines, int threads)
+{
+    num_workers = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    if (num_workers < 1) { num_workers = 1; }
+    for (int i=0; i<num_workers; i++) {
+        // Candidates have no opening index, the winner is indexed when it is copied
+        // onto a board that has one
+        candidates.push_back(new MineBoard(width, height, num_mines));
+        solvers.push_back(new MineSolver(width, height));
+    }
+    candidates_tried = 0;
+    fallbacks = 0;
+}
+
+NoGuessGenerator::~NoGuessGenerator()
+{
+    for (int i=0; i<num_workers; i++) {
+        delete candidates[i];
+        delete solvers[i];
+    }
+}
+
+// Keep trying candidates until one passes, someone else wins or time is up
+void NoGuessGenerator::race(int worker, int x, int y, std::chrono::steady_clock::time_point deadline)
+{
+    MineBoard* candidate = candidates[worker];
+    MineSolver* solver = solvers[worker];
+    int sx, sy;
+
+    while (winner.load(std::memory_order_relaxed) < 0 && std::chrono::steady_clock::now() < deadline) {
+        candidate->reset(x, y);
+        solver->reset();
+        candidate->sweep(x, y);
+        while (candidate->status() == PLAYING) {
+            solver->update(candidate);
+            if (!solver->nextSafe(&sx, &sy)) { break; }
+            candidate->sweep(sx, sy);
+        }
+        tried++;
+
+        if (candidate->status() == WON) {
+            int none = -1;
+            winner.compare_exchange_strong(none, worker);
+            return;
+        }
+    }
+}
+
+int NoGuessGenerator::generate(MineBoard* board, int x, int y, int budget_ms)
+{
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(budget_ms);
+    winner = -1;
+    tried = 0;
+
+    if (num_workers == 1) {
+        race(0, x, y, deadline);
+    }
+    else {
+        std::vector<std::thread> pool;
+        for (int i=0; i<num_workers; i++) {
+            pool.push_back(std::thread(&NoGuessGenerator::race, this, i, x, y, deadline));
+        }
+        for (int i=0; i<num_workers; i++) { pool[i].join(); }
+    }
+    candidates_tried += tried;
+
+    if (winner < 0) {
+        fallbacks++;
+        board->reset(x, y);
+        return 0;
+    }
+    board->copy_layout(candidates[winner]);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef PROFILER_CPP
+#define PROFILER_CPP
+
+#include <SDL.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+//Frame stage profiler
+//
+//Stages of the main loop are timed with SDL_GetPerformanceCounter and the
+//samples go into a fixed ring buffer. The main thread is the only writer and
+//publishes each sample by bumping an atomic head, so readers never take a lock
+//and recording costs two counter reads and a store. Percentiles and the trace
+//export read the most recent samples.
+
+enum ProfileStage
+{
+	STAGE_EVENTS,	//handling the queued events, includes STAGE_LOGIC
+	STAGE_LOGIC,	//sweep, flag, reset and board generation
+	STAGE_STATUS,	//game over checks
+	STAGE_DRAW,		//bringing the board cache up to date and copying it out
+	STAGE_PRESENT,	//SDL_RenderPresent
+	NUM_STAGES
+};
+
+const char* STAGE_NAMES[ NUM_STAGES ] = { "events", "logic", "status", "draw", "present" };
+
+//Must be a power of two
+#define PROFILE_RING_SIZE 8192
+
+struct ProfileSample
+{
+	Uint64 start;
+	Uint64 end;
+	Uint32 frame;
+	int stage;
+};
+
+class FrameProfiler
+{
+	public:
+		//Initializes variables
+		FrameProfiler();
+
+		//Returns a timestamp to hand back to end()
+		Uint64 begin();
+
+		//Records stage as running from start until now
+		void end( int stage, Uint64 start );
+
+		//Call once per loop iteration, samples are tagged with the frame number
+		void nextFrame();
+
+		//Stage duration percentile over the recent samples, in microseconds
+		double percentile( int stage, double p );
+
+		//Writes the recent samples as Chrome trace event JSON, returns false on failure
+		bool exportTrace( const char* path );
+
+	private:
+		//Copies out the recent samples, oldest first
+		void snapshot( std::vector<ProfileSample>* out );
+
+		ProfileSample mRing[ PROFILE_RING_SIZE ];
+		std::atomic<Uint64> mHead;
+		Uint32 mFrame;
+		double mTicksPerMicro;
+		std::vector<ProfileSample> mScratch;
+		std::vector<double> mDurations;
+};
+
+FrameProfiler::FrameProfiler()
+{
+	mHead = 0;
+	mFrame = 0;
+	mTicksPerMicro = SDL_GetPerformanceFrequency() / 1e6;
+	mScratch.reserve( PROFILE_RING_SIZE );
+	mDurations.reserve( PROFILE_RING_SIZE );
+}
+
+Uint64 FrameProfiler::begin()
+{
+	return SDL_GetPerformanceCounter();
+}
+
+void FrameProfiler::end( int stage, Uint64 start )
+{
+	Uint64 head = mHead.load( std::memory_order_relaxed );
+	ProfileSample& sample = mRing[ head & ( PROFILE_RING_SIZE - 1 ) ];
+	sample.start = start;
+	sample.end = SDL_GetPerformanceCounter();
+	sample.frame = mFrame;
+	sample.stage = stage;
+	//Publish after the sample is written
+	mHead.store( head + 1, std::memory_order_release );
+}
+
+void FrameProfiler::nextFrame()
+{
+	mFrame++;
+}
+
+void FrameProfiler::snapshot( std::vector<ProfileSample>* out )
+{
+	Uint64 head = mHead.load( std::memory_order_acquire );
+	Uint64 count = head < PROFILE_RING_SIZE ? head : PROFILE_RING_SIZE;
+	out->clear();
+	for( Uint64 i = head - count; i < head; ++i )
+	{
+		out->push_back( mRing[ i & ( PROFILE_RING_SIZE - 1 ) ] );
+	}
+}
+
+double FrameProfiler::percentile( int stage, double p )
+{
+	snapshot( &mScratch );
+	mDurations.clear();
+	for( size_t i = 0; i < mScratch.size(); ++i )
+	{
+		if( mScratch[ i ].stage == stage )
+		{
+			mDurations.push_back( ( mScratch[ i ].end - mScratch[ i ].start ) / mTicksPerMicro );
+		}
+	}
+	if( mDurations.empty() )
+	{
+		return 0;
+	}
+
+	size_t rank = (size_t)( p * ( mDurations.size() - 1 ) + 0.5 );
+	std::nth_element( mDurations.begin(), mDurations.begin() + rank, mDurations.end() );
+	return mDurations[ rank ];
+}
+
+bool FrameProfiler::exportTrace( const char* path )
+{
+	FILE* file = fopen( path, "w" );
+	if( file == NULL )
+	{
+		return false;
+	}
+
+	snapshot( &mScratch );
+	//Samples are recorded when a stage ends, so STAGE_EVENTS comes after the
+	//STAGE_LOGIC it encloses although it started first; time starts at the earliest
+	Uint64 origin = mScratch.empty() ? 0 : mScratch[ 0 ].start;
+	for( size_t i = 1; i < mScratch.size(); ++i )
+	{
+		if( mScratch[ i ].start < origin )
+		{
+			origin = mScratch[ i ].start;
+		}
+	}
+
+	//Complete events, timestamps and durations in microseconds
+	fprintf( file, "{\"traceEvents\": [\n" );
+	for( size_t i = 0; i < mScratch.size(); ++i )
+	{
+		const ProfileSample& sample = mScratch[ i ];
+		fprintf( file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %u}}",
+			i == 0 ? "" : ",\n", STAGE_NAMES[ sample.stage ],
+			( sample.start - origin ) / mTicksPerMicro, ( sample.end - sample.start ) / mTicksPerMicro, sample.frame );
+	}
+	fprintf( file, "\n], \"displayTimeUnit\": \"ms\"}\n" );
+
+	bool success = !ferror( file );
+	if( fclose( file ) != 0 )
+	{
+		success = false;
+	}
+	return success;
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef REPLAY_CPP
+#define REPLAY_CPP
+
+#include <stdint.h>
+#include <vector>
+
+#include <MineBoard.cpp>
+
+// Replay log
+//
+// A replay file is a 4 byte magic and a version byte followed by events. An
+// event is a tag byte and unsigned LEB128 varints:
+//
+//   RESET  width, height, mines, seed, safe_x + 1, safe_y + 1
+//   SWEEP  ms since the previous event, zigzag delta of the square index
+//   FLAG   ms since the previous event, zigzag delta of the square index
+//   CHORD  ms since the previous event, zigzag delta of the square index
+//   END    ms since the previous event, final status, claimed game time in ms
+//
+// The board is rebuilt exactly from the seed and safe square with
+// MineBoard::reset(seed, safe_x, safe_y), so a game costs a few bytes per move.
+// Square indices are y*width + x and delta coded against the previous move of
+// the game, nearby moves take one byte. A file may hold any number of games.
+// Version 2 added CHORD, a chord is replayed as one move so a wrong flag that
+// opens a mine ends the game there. Version 1 files still verify.
+
+#define REPLAY_MAGIC "MSRP"
+#define REPLAY_VERSION 2
+#define REPLAY_HEADER_SIZE 5
+// Biggest board a RESET may ask the verifier for, a file is untrusted input
+#define REPLAY_MAX_SQUARES (1 << 24)
+
+enum ReplayTag
+{
+    REPLAY_RESET = 1, REPLAY_SWEEP, REPLAY_FLAG, REPLAY_END, REPLAY_CHORD
+};
+
+class ReplayWriter
+{
+    public:
+    ReplayWriter();
+
+    // Times are a millisecond clock of the caller's choosing, only differences are kept.
+    // Call reset after the board was reset, with the safe square it was given (-1 for none)
+    void reset(MineBoard* board, int safe_x, int safe_y, uint32_t ms);
+    void sweep(int x, int y, uint32_t ms);
+    void flag(int x, int y, uint32_t ms);
+    void chord(int x, int y, uint32_t ms);
+    void end(MineBoard* board, uint32_t ms);
+    // Drop the game in progress, e.g. when the board was replaced from outside
+    void abandon();
+
+    // Append every finished game to path, writing the file header if it is new.
+    // Returns 0, or -1 with errno set. The finished games are dropped either way.
+    int append(const char* path);
+    // Drop the finished games without writing them
+    void clear();
+    const std::vector<unsigned char>& data() { return buffer; }
+
+    private:
+    void put(uint64_t value);
+    void move(int tag, int x, int y, uint32_t ms);
+
+    std::vector<unsigned char> buffer;
+    size_t game_start;  // where the game in progress starts in buffer
+    int in_game;
+    int width;
+    int64_t last_index;
+    uint32_t last_ms;
+    uint32_t start_ms;
+};
+
+// Unsigned LEB128, 7 bits per byte low first
+void ReplayWriter::put(uint64_t value)
+{
+    while (value >= 0x80) {
+        buffer.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((unsigned char)value);
+}
+
+static inline uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+static inline int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+ReplayWriter::ReplayWriter()
+{
+    game_start = 0;
+    in_game = 0;
+    width = 0;
+    last_index = 0;
+    last_ms = start_ms = 0;
+}
+
+void ReplayWriter::reset(MineBoard* board, int safe_x, int safe_y, uint32_t ms)
+{
+    abandon();
+    game_start = buffer.size();
+    in_game = 1;
+    width = board->getWidth();
+    last_index = 0;
+    last_ms = start_ms = ms;
+
+    buffer.push_back(REPLAY_RESET);
+    put(board->getWidth());
+    put(board->getHeight());
+    put(board->numMines());
+    put(board->getSeed());
+    put(safe_x + 1);
+    put(safe_y + 1);
+}
+
+void ReplayWriter::move(int tag, int x, int y, uint32_t ms)
+{
+    if (!in_game) { return; }
+    int64_t index = (int64_t)y*width + x;
+    buffer.push_back(tag);
+    put(ms - last_ms);
+    put(zigzag(index - last_index));
+    last_index = index;
+    last_ms = ms;
+}
+
+void ReplayWriter::sweep(int x, int y, uint32_t ms) { move(REPLAY_SWEEP, x, y, ms); }
+void ReplayWriter::flag(int x, int y, uint32_t ms) { move(REPLAY_FLAG, x, y, ms); }
+void ReplayWriter::chord(int x, int y, uint32_t ms) { move(REPLAY_CHORD, x, y, ms); }
+
+void ReplayWriter::end(MineBoard* board, uint32_t ms)
+{
+    if (!in_game) { return; }
+    buffer.push_back(REPLAY_END);
+    put(ms - last_ms);
+    put(board->status());
+    put(ms - start_ms);
+    in_game = 0;
+    game_start = buffer.size();
+}
+
+void ReplayWriter::abandon()
+{
+    if (in_game) { buffer.resize(game_start); }
+    in_game = 0;
+}
+
+int ReplayWriter::append(const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) { return -1; }
+
+    int result = 0;
+    struct stat info;
+    if (fstat(fd, &info) < 0) { result = -1; }
+    else {
+        unsigned char header[REPLAY_HEADER_SIZE] = { 'M', 'S', 'R', 'P', REPLAY_VERSION };
+        struct iovec parts[2];
+        int count = 0;
+        if (info.st_size == 0) {
+            parts[count].iov_base = header;
+            parts[count++].iov_len = sizeof(header);
+        }
+        parts[count].iov_base = buffer.data();
+        parts[count++].iov_len = game_start;
+        ssize_t expected = (info.st_size == 0 ? sizeof(header) : 0) + game_start;
+        ssize_t written = writev(fd, parts, count);
+        if (written != expected) {
+            if (written >= 0) { errno = EIO; }
+            result = -1;
+        }
+    }
+    if (close(fd) < 0) { result = -1; }
+
+    clear();
+    return result;
+}
+
+void ReplayWriter::clear()
+{
+    // Keep the game in progress, if any
+    buffer.erase(buffer.begin(), buffer.begin() + game_start);
+    game_start = 0;
+}
+
+// Results of checking replays, summed over files and threads
+struct ReplayStats
+{
+    long games;       // games that reached END
+    long verified;    // ... and whose status and time matched the re-run
+    long wrong_status;
+    long wrong_time;
+    long illegal;     // squares off the board, moves after the game ended
+    long unfinished;  // games replaced by the next RESET or cut off by the end of the file
+    long malformed;   // files that stopped decoding part way
+    long events;
+};
+
+// Re-runs replays on one board, which only grows when a replay needs a bigger one
+class ReplayVerifier
+{
+    public:
+    ReplayVerifier() : board(1, 1, 0, 1) {}
+
+    // Check every game in a replay file image, adds to stats
+    void verify(const unsigned char* data, size_t size, ReplayStats* stats);
+
+    private:
+    MineBoard board;
+};
+
+// Decode a varint, returns 0 past the end or on an overlong encoding
+static inline int get_varint(const unsigned char** p, const unsigned char* end, uint64_t* value)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    while (*p < end && shift < 64) {
+        unsigned char byte = *(*p)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+void ReplayVerifier::verify(const unsigned char* data, size_t size, ReplayStats* stats)
+{
+    const unsigned char* p = data;
+    const unsigned char* end = data + size;
+    if (size < REPLAY_HEADER_SIZE || memcmp(data, REPLAY_MAGIC, 4) != 0 || data[4] < 1 || data[4] > REPLAY_VERSION) {
+        stats->malformed++;
+        return;
+    }
+    p += REPLAY_HEADER_SIZE;
+
+    int in_game = 0, legal = 1;
+    int64_t index = 0, cells = 0;
+    uint64_t elapsed = 0;
+    uint64_t v[6];
+
+    while (p < end) {
+        int tag = *p++;
+        stats->events++;
+
+        if (tag == REPLAY_RESET) {
+            int i;
+            for (i=0; i<6 && get_varint(&p, end, &v[i]); i++) {}
+            // sizes are kept well inside int so board arithmetic can not overflow
+            if (i < 6 || v[0] < 1 || v[1] < 1 || v[0] > 1 << 20 || v[1] > 1 << 20
+                || v[0]*v[1] > REPLAY_MAX_SQUARES || v[2] > v[0]*v[1] || v[4] > v[0] || v[5] > v[1]) {
+                stats->malformed++;
+                return;
+            }
+            if (in_game) { stats->unfinished++; }
+            try {
+                board.resize((int)v[0], (int)v[1], (int)v[2]);
+                board.reset(v[3], (int)v[4] - 1, (int)v[5] - 1);
+            }
+            catch (std::bad_alloc&) {
+                stats->malformed++;
+                return;
+            }
+            cells = (int64_t)(v[0]*v[1]);
+            in_game = 1;
+            legal = 1;
+            index = 0;
+            elapsed = 0;
+        }
+        else if (tag == REPLAY_SWEEP || tag == REPLAY_FLAG || tag == REPLAY_CHORD) {
+            if (!in_game || !get_varint(&p, end, &v[0]) || !get_varint(&p, end, &v[1])) {
+                stats->malformed++;
+                return;
+            }
+            elapsed += v[0];
+            index += unzigzag(v[1]);
+            if (index < 0 || index >= cells || board.status() != PLAYING) {
+                legal = 0;
+                continue;
+            }
+            int x = (int)(index % board.getWidth()), y = (int)(index / board.getWidth());
+            if (tag == REPLAY_SWEEP) { board.sweep(x, y); }
+            else if (tag == REPLAY_CHORD) { board.chord(x, y); }
+            else { board.flag(x, y); }
+        }
+        else if (tag == REPLAY_END) {
+            if (!in_game || !get_varint(&p, end, &v[0]) || !get_varint(&p, end, &v[1])
+                || !get_varint(&p, end, &v[2])) {
+                stats->malformed++;
+                return;
+            }
+            elapsed += v[0];
+            in_game = 0;
+            stats->games++;
+            if (!legal) { stats->illegal++; }
+            else if (v[1] != (uint64_t)board.status()) { stats->wrong_status++; }
+            else if (v[2] != elapsed) { stats->wrong_time++; }
+            else { stats->verified++; }
+        }
+        else {
+            stats->malformed++;
+            return;
+        }
+        // nothing is kept between games, the change list would only grow
+        board.clearChanges();
+    }
+    if (in_game) { stats->unfinished++; }
+}
+
+#endif
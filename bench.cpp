@@ -0,0 +1,363 @@
+// MineBoard microbenchmarks
+// Times the board engine's core operations over a range of board sizes and
+// mine densities and prints the results as JSON, one object per case, so two
+// builds can be diffed.
+//
+// usage: bench [-t min_ms] [-f filter] [-s max_side] [-n]
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+
+#include <MineBoard.cpp>
+#include <FixedMineBoard.cpp>
+
+// Allocation counting. glibc lets the program supply malloc and friends and
+// still reach the real ones, operator new ends up here too.
+static long alloc_count = 0;
+static long alloc_bytes = 0;
+
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+#define ALLOC_COUNTING 1
+#else
+#define ALLOC_COUNTING 0
+#endif
+
+static volatile long sink;
+
+#if defined(__AVX2__)
+#define AVX2_ENABLED 1
+#else
+#define AVX2_ENABLED 0
+#endif
+
+struct BenchCase
+{
+    int width, height, mines;
+    double density;
+    const char* board;  // "runtime" for MineBoard, "fixed" for FixedMineBoard
+};
+
+// Runs a timed section and remembers what it cost
+struct Measure
+{
+    double seconds;
+    long ops;
+    long cells;  // squares processed, for cells/sec
+    long allocs;
+    long bytes;
+
+    Measure() : seconds(0), ops(0), cells(0), allocs(0), bytes(0) {
+        begun = std::chrono::steady_clock::now();
+    }
+
+    // Timed long enough, or untimed setup has taken far longer than that
+    bool done(double min_seconds) {
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begun).count();
+        return seconds >= min_seconds || (ops > 0 && wall >= 20 * min_seconds);
+    }
+
+    std::chrono::steady_clock::time_point begun;
+    std::chrono::steady_clock::time_point start_time;
+    long start_allocs, start_bytes;
+
+    void start() {
+        start_allocs = alloc_count;
+        start_bytes = alloc_bytes;
+        start_time = std::chrono::steady_clock::now();
+    }
+    void stop(long done_ops, long done_cells) {
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        allocs += alloc_count - start_allocs;
+        bytes += alloc_bytes - start_bytes;
+        ops += done_ops;
+        cells += done_cells;
+    }
+};
+
+static int first_result = 1;
+static int index_openings = 1;
+
+void report(const BenchCase* c, const char* op, const Measure* m)
+{
+    double ops = m->ops > 0 ? (double)m->ops : 1.0;
+    printf("%s    {\"op\": \"%s\", \"board\": \"%s\", \"width\": %d, \"height\": %d, \"mines\": %d, \"density\": %.3f, "
+        "\"ops\": %ld, \"ns_per_op\": %.2f, \"cells_per_sec\": %.0f, \"allocs_per_op\": %.4f, \"bytes_per_op\": %.1f}",
+        first_result ? "" : ",\n", op, c->board, c->width, c->height, c->mines, c->density,
+        m->ops, 1e9 * m->seconds / ops, m->seconds > 0 ? m->cells / m->seconds : 0.0,
+        m->allocs / ops, m->bytes / ops);
+    first_result = 0;
+    fflush(stdout);
+}
+
+// Squares of the current layout showing want when uncovered (0 for openings,
+// -1 for any number), read off an uncovered copy of the board
+template <typename Board>
+void find_squares(Board* board, Board* scratch, int want, std::vector<int>* out)
+{
+    scratch->copy_layout(board);
+    scratch->uncover_board();
+    out->clear();
+    for (int y=0; y<board->getHeight(); y++) {
+        for (int x=0; x<board->getWidth(); x++) {
+            int shown = scratch->showSquare(x, y);
+            if ((want == 0 && shown == SAFE) || (want < 0 && shown >= 1 && shown <= 8)) {
+                out->push_back(y*board->getWidth() + x);
+            }
+        }
+    }
+}
+
+// Every op on one board type, board and scratch are c's size
+template <typename Board>
+void run_case(const BenchCase* c, Board* board, Board* scratch, double min_seconds, const char* filter)
+{
+    long cells = (long)c->width * c->height;
+    std::vector<int> squares;
+    squares.reserve(cells);
+    int x, y;
+
+    // reset: place mines and number the board
+    if (strstr("reset", filter)) {
+        Measure m;
+        board->reset();  // warm up
+        while (!m.done(min_seconds)) {
+            m.start();
+            board->reset();
+            m.stop(1, cells);
+        }
+        report(c, "reset", &m);
+    }
+
+    // sweep_number: single square reveals, every numbered square of a layout in turn
+    if (strstr("sweep_number", filter)) {
+        Measure m;
+        while (!m.done(min_seconds)) {
+            board->reset();
+            find_squares(board, scratch, -1, &squares);
+            if (squares.empty()) { break; }
+            board->clearChanges();
+            m.start();
+            for (size_t i=0; i<squares.size(); i++) {
+                board->sweep(squares[i] % c->width, squares[i] / c->width);
+            }
+            board->clearChanges();
+            m.stop((long)squares.size(), (long)squares.size());
+        }
+        if (m.ops > 0) { report(c, "sweep_number", &m); }
+    }
+
+    // sweep_opening: flood fills, every opening of a layout once. cells/sec
+    // counts what they revealed; low densities give the huge openings
+    if (strstr("sweep_opening", filter)) {
+        Measure m;
+        int attempts = 0;
+        while (!m.done(min_seconds) && attempts++ < 1000) {
+            board->reset();
+            find_squares(board, scratch, 0, &squares);
+            if (squares.empty()) { continue; }
+            board->clearChanges();
+            long openings = 0;
+            m.start();
+            for (size_t i=0; i<squares.size(); i++) {
+                x = squares[i] % c->width, y = squares[i] / c->width;
+                if (board->showSquare(x, y) != COVER) { continue; }
+                board->sweep(x, y);
+                openings++;
+            }
+            long revealed = (long)board->changedCells().size();
+            board->clearChanges();
+            m.stop(openings, revealed);
+        }
+        if (m.ops > 0) { report(c, "sweep_opening", &m); }
+    }
+
+    // sweep_batch: the squares of sweep_opening handed over in one call, ops are
+    // batches. cells/sec compares with sweep_opening
+    if (strstr("sweep_batch", filter)) {
+        Measure m;
+        std::vector<int> coords;
+        coords.reserve(2*cells);
+        int attempts = 0;
+        while (!m.done(min_seconds) && attempts++ < 1000) {
+            board->reset();
+            find_squares(board, scratch, 0, &squares);
+            if (squares.empty()) { continue; }
+            coords.clear();
+            for (size_t i=0; i<squares.size(); i++) {
+                coords.push_back(squares[i] % c->width);
+                coords.push_back(squares[i] / c->width);
+            }
+            board->clearChanges();
+            m.start();
+            size_t revealed = board->sweep_batch(coords.data(), squares.size());
+            board->clearChanges();
+            m.stop(1, (long)revealed);
+        }
+        if (m.ops > 0) { report(c, "sweep_batch", &m); }
+    }
+
+    // flag: flag then unflag every square
+    if (strstr("flag", filter)) {
+        Measure m;
+        board->reset();
+        while (!m.done(min_seconds)) {
+            m.start();
+            for (y=0; y<c->height; y++) {
+                for (x=0; x<c->width; x++) { board->flag(x, y); }
+            }
+            for (y=0; y<c->height; y++) {
+                for (x=0; x<c->width; x++) { board->flag(x, y); }
+            }
+            board->clearChanges();
+            m.stop(2*cells, 2*cells);
+        }
+        report(c, "flag", &m);
+    }
+
+    // show_scan: showSquare over the whole board, what a renderer does
+    if (strstr("show_scan", filter)) {
+        Measure m;
+        board->reset();
+        while (!m.done(min_seconds)) {
+            long sum = 0;
+            m.start();
+            for (y=0; y<c->height; y++) {
+                for (x=0; x<c->width; x++) { sum += board->showSquare(x, y); }
+            }
+            m.stop(cells, cells);
+            sink = sum;
+        }
+        report(c, "show_scan", &m);
+    }
+
+    // check_win / check_lose: asked after every move
+    if (strstr("check_win", filter)) {
+        Measure m;
+        board->reset();
+        while (!m.done(min_seconds)) {
+            long sum = 0;
+            m.start();
+            for (int i=0; i<1000000; i++) {
+                sum += board->check_win();
+                // keep the compiler from hoisting the call out of the loop
+                __asm__ __volatile__("" ::: "memory");
+            }
+            m.stop(1000000, 0);
+            sink = sum;
+        }
+        report(c, "check_win", &m);
+    }
+    if (strstr("check_lose", filter)) {
+        Measure m;
+        board->reset();
+        while (!m.done(min_seconds)) {
+            long sum = 0;
+            m.start();
+            for (int i=0; i<1000000; i++) {
+                sum += board->check_lose();
+                __asm__ __volatile__("" ::: "memory");
+            }
+            m.stop(1000000, 0);
+            sink = sum;
+        }
+        report(c, "check_lose", &m);
+    }
+}
+
+// The standard sizes on FixedMineBoard, next to the same sizes on MineBoard
+template <typename Fixed>
+void run_fixed(double min_seconds, const char* filter)
+{
+    BenchCase c;
+    c.width = Fixed::getWidth();
+    c.height = Fixed::getHeight();
+    c.mines = Fixed::numMines();
+    c.density = (double)c.mines / (c.width * c.height);
+
+    c.board = "runtime";
+    MineBoard board(c.width, c.height, c.mines, 1);
+    MineBoard scratch(c.width, c.height, c.mines, 1);
+    board.indexOpenings(index_openings);
+    run_case(&c, &board, &scratch, min_seconds, filter);
+
+    c.board = "fixed";
+    Fixed fixed_board(1);
+    Fixed fixed_scratch(1);
+    run_case(&c, &fixed_board, &fixed_scratch, min_seconds, filter);
+}
+
+void usage()
+{
+    printf("usage: bench [-t min_ms] [-f filter] [-s max_side] [-n]\n");
+    printf("ops: reset sweep_number sweep_opening sweep_batch flag show_scan check_win check_lose\n");
+    printf("-f runs only the ops whose name contains filter\n");
+    printf("-n turns the opening index off, sweeps flood fill instead\n");
+}
+
+int main(int argc, char* argv[])
+{
+    double min_seconds = 0.1;
+    const char* filter = "";
+    int max_side = 4096;
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-n") == 0) { index_openings = 0; continue; }
+        if (i+1 >= argc) { usage(); return 1; }
+        if (strcmp(argv[i], "-t") == 0) { min_seconds = atof(argv[++i]) / 1000.0; }
+        else if (strcmp(argv[i], "-f") == 0) { filter = argv[++i]; }
+        else if (strcmp(argv[i], "-s") == 0) { max_side = atoi(argv[++i]); }
+        else { usage(); return 1; }
+    }
+
+    static const int sides[][2] = { {9, 9}, {16, 16}, {30, 16}, {256, 256}, {1024, 1024}, {4096, 4096} };
+    static const double densities[] = { 0.01, 0.12, 0.206 };
+
+    printf("{\n  \"avx2\": %s,\n  \"alloc_counting\": %s,\n  \"opening_index\": %s,\n  \"results\": [\n",
+        AVX2_ENABLED ? "true" : "false", ALLOC_COUNTING ? "true" : "false", index_openings ? "true" : "false");
+    for (size_t s=0; s<sizeof(sides)/sizeof(sides[0]); s++) {
+        if (sides[s][0] > max_side || sides[s][1] > max_side) { continue; }
+        for (size_t d=0; d<sizeof(densities)/sizeof(densities[0]); d++) {
+            BenchCase c;
+            c.width = sides[s][0];
+            c.height = sides[s][1];
+            c.density = densities[d];
+            c.mines = (int)(densities[d] * c.width * c.height + 0.5);
+            if (c.mines < 1) { c.mines = 1; }
+            c.board = "runtime";
+            MineBoard board(c.width, c.height, c.mines, 1);
+            MineBoard scratch(c.width, c.height, c.mines, 1);
+            board.indexOpenings(index_openings);
+            run_case(&c, &board, &scratch, min_seconds, filter);
+        }
+    }
+    run_fixed<BeginnerBoard>(min_seconds, filter);
+    run_fixed<IntermediateBoard>(min_seconds, filter);
+    run_fixed<ExpertBoard>(min_seconds, filter);
+    printf("\n  ]\n}\n");
+    return 0;
+}
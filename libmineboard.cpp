@@ -0,0 +1,132 @@
+// C ABI over MineBoard, built as libmineboard (see mineboard.h)
+//
+// The handle is the MineBoard itself. The library is built with hidden
+// visibility and linked with mineboard.map, so only the mineboard_* functions
+// are exported and the C++ side can change without breaking callers.
+
+#include <mineboard.h>
+#include <MineBoard.cpp>
+
+// The header repeats the engine's constants for C callers
+static_assert(MINEBOARD_CELL_ADJ_MASK == CELL_ADJ_MASK && MINEBOARD_CELL_MINE == CELL_MINE
+              && MINEBOARD_CELL_FLAG == CELL_FLAG && MINEBOARD_CELL_COVER == CELL_COVER, "cell bits");
+static_assert(MINEBOARD_FLAG == FLAG && MINEBOARD_COVER == COVER && MINEBOARD_MINE == MINE_VALUE, "shown values");
+static_assert(MINEBOARD_PLAYING == PLAYING && MINEBOARD_WON == WON && MINEBOARD_LOST == LOST, "status");
+
+// Sizes stay well inside int so board arithmetic can not overflow
+#define MINEBOARD_MAX_SIDE (1 << 20)
+#define MINEBOARD_MAX_SQUARES (1 << 30)
+
+static inline MineBoard* unwrap(mineboard* board) { return (MineBoard*)board; }
+
+int mineboard_abi_version(void)
+{
+    return MINEBOARD_ABI_VERSION;
+}
+
+mineboard* mineboard_create(int width, int height, int mines, uint64_t seed)
+{
+    if (width < 1 || height < 1 || width > MINEBOARD_MAX_SIDE || height > MINEBOARD_MAX_SIDE
+        || (int64_t)width*height > MINEBOARD_MAX_SQUARES || mines < 0 || (int64_t)mines > (int64_t)width*height) {
+        return NULL;
+    }
+    // The constructor throws std::bad_alloc for the cells and the scratch vectors alike
+    MineBoard* board = NULL;
+    try {
+        board = new MineBoard(width, height, mines, seed);
+    }
+    catch (...) {
+        return NULL;
+    }
+    return (mineboard*)board;
+}
+
+void mineboard_destroy(mineboard* board)
+{
+    delete unwrap(board);
+}
+
+int mineboard_reset(mineboard* board, uint64_t seed, int safe_x, int safe_y)
+{
+    MineBoard* b = unwrap(board);
+    if (!(safe_x == -1 && safe_y == -1)
+        && (safe_x < 0 || safe_y < 0 || safe_x >= b->getWidth() || safe_y >= b->getHeight())) {
+        return -1;
+    }
+    try {
+        b->reset(seed, safe_x, safe_y);
+    }
+    catch (...) {
+        return -1;
+    }
+    // Nobody reads the change list through the C side, keep it from growing
+    b->clearChanges();
+    return 0;
+}
+
+int mineboard_sweep(mineboard* board, int x, int y)
+{
+    MineBoard* b = unwrap(board);
+    int shown;
+    try {
+        shown = b->sweep(x, y);
+    }
+    catch (...) {
+        return -1;
+    }
+    b->clearChanges();
+    return shown;
+}
+
+size_t mineboard_sweep_batch(mineboard* board, const int* squares, size_t count)
+{
+    MineBoard* b = unwrap(board);
+    size_t changed;
+    try {
+        changed = b->sweep_batch(squares, count);
+    }
+    catch (...) {
+        return 0;
+    }
+    b->clearChanges();
+    return changed;
+}
+
+void mineboard_flag(mineboard* board, int x, int y)
+{
+    MineBoard* b = unwrap(board);
+    try {
+        b->flag(x, y);
+    }
+    catch (...) {}
+    b->clearChanges();
+}
+
+int mineboard_chord(mineboard* board, int x, int y)
+{
+    MineBoard* b = unwrap(board);
+    int result;
+    try {
+        result = b->chord(x, y);
+    }
+    catch (...) {
+        return -1;
+    }
+    b->clearChanges();
+    return result;
+}
+
+int mineboard_status(mineboard* board) { return unwrap(board)->status(); }
+int mineboard_show(mineboard* board, int x, int y) { return unwrap(board)->showSquare(x, y); }
+int mineboard_width(mineboard* board) { return unwrap(board)->getWidth(); }
+int mineboard_height(mineboard* board) { return unwrap(board)->getHeight(); }
+int mineboard_num_mines(mineboard* board) { return unwrap(board)->numMines(); }
+int mineboard_num_flags(mineboard* board) { return unwrap(board)->numFlags(); }
+uint64_t mineboard_seed(mineboard* board) { return unwrap(board)->getSeed(); }
+
+const uint8_t* mineboard_cells(mineboard* board, size_t* stride)
+{
+    MineBoard* b = unwrap(board);
+    if (stride != NULL) { *stride = (size_t)b->getWidth(); }
+    return b->cellData();
+}
@@ -6,11 +6,25 @@ and may not be redistributed without written permission.*/
 #include <SDL_image.h>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 #include <MineBoard.cpp>
+#include <NoGuess.cpp>
+#include <BoardQueue.cpp>
+#include <Replay.cpp>
+#include <Profiler.cpp>
 
-#define IMAGE_STAT_BG "../assets/game_stats_background.png"
+//Generated at build time from assets/ by tools/embed_assets.py
+#include <embedded_assets.h>
+
+//Images, built in unless --assets names a directory to load them from
+#define IMAGE_TILES "WinmineXP.png"
+#define IMAGE_STAT_BG "game_stats_background.png"
 #define IMAGE_NUM_FONT "numbers.png"
+#define IMAGE_BORDERS "borders.png"
+
+// Longest the idle loop sleeps before waking up to check the game state again
+#define IDLE_TIMEOUT_MS 1000
 
 //Button constants
 const int BUTTON_WIDTH = 16;
@@ -22,19 +36,41 @@ const int MINESPRITE_SIZE = 16;
 const int NUM_SPRITES = 16;
 const int SCALING = 2;
 
-//Screen dimension constants
-
+//Board defaults, -w -h -m override them
 const int NUM_WIDTH = 10;
 const int NUM_HEIGHT = 10;
 const int NUM_MINES = 10;
 
+//Window size limits in tiles, bigger boards are panned and zoomed inside the window
+const int VIEW_MIN_COLS = 10; // the stats panel needs this much room
+const int VIEW_MAX_COLS = 40;
+const int VIEW_MAX_ROWS = 24;
+
+//Camera zoom range and keyboard pan step, in pixels
+const int MIN_TILE_SIZE = 8;
+const int MAX_TILE_SIZE = 64;
+const int PAN_STEP = 64;
+
 const int SCREEN_PADDING = MINESPRITE_SIZE*SCALING;
 
-const int BOARD_WIDTH = MINESPRITE_SIZE*SCALING*NUM_WIDTH;
-const int BOARD_HEIGHT = MINESPRITE_SIZE*SCALING*NUM_HEIGHT;
+//Board and window dimensions, set by setScreenSize()
+int gBoardCols = NUM_WIDTH;
+int gBoardRows = NUM_HEIGHT;
+int gBoardMines = NUM_MINES;
+
+int gViewCols, gViewRows;
+int gViewWidth, gViewHeight;
+
+int gScreenWidth, gScreenHeight;
+
+//Part of the board shown in the window: top left corner in board pixels and the tile size
+struct Camera
+{
+	int x, y;
+	int tileSize;
+};
 
-const int SCREEN_WIDTH = SCREEN_PADDING*2+BOARD_WIDTH;
-const int SCREEN_HEIGHT =  SCREEN_PADDING*3+BOARD_HEIGHT + 48*SCALING;
+Camera gCamera = { 0, 0, MINESPRITE_SIZE*SCALING };
 
 enum SpriteStates
 {
@@ -71,6 +107,9 @@ class LTexture
 
 		//Loads image at specified path
 		bool loadFromFile( std::string path );
+
+		//Creates texture from RGBA pixels, 4 bytes a pixel with no row padding
+		bool loadFromPixels( const unsigned char* pixels, int width, int height );
 		
 		#if defined(SDL_TTF_MAJOR_VERSION)
 		//Creates image from font string
@@ -96,6 +135,9 @@ class LTexture
 		int getWidth();
 		int getHeight();
 
+		//Gets the hardware texture
+		SDL_Texture* getTexture();
+
 	private:
 		//The actual hardware texture
 		SDL_Texture* mTexture;
@@ -105,12 +147,44 @@ class LTexture
 		int mHeight;
 };
 
+//Collects sprites from one atlas and draws them with a single SDL_RenderGeometry call
+class SpriteBatch
+{
+	public:
+		//Initializes variables
+		SpriteBatch();
+
+		//Sets the atlas and turns its clip rects into texture coordinates
+		void setAtlas( LTexture* atlas, SDL_Rect* clips, int numClips );
+
+		//Queues sprite clip at x, y drawn w by h, relative to the current viewport
+		void add( int clip, int x, int y, int w, int h );
+
+		//Draws everything queued and empties the batch
+		void flush();
+
+	private:
+		LTexture* mAtlas;
+		std::vector<SDL_FRect> mUVs;
+		std::vector<SDL_Vertex> mVertices;
+		std::vector<int> mIndices;
+};
+
+//Sizes the window for the board
+void setScreenSize();
+
 //Starts up SDL and creates window
 bool init();
 
+//Loads an image into texture from the asset directory, or the built in copy
+bool loadImage( LTexture* texture, const char* name );
+
 //Loads media
 bool loadMedia();
 
+//Creates the texture the board is cached in
+bool createBoardCache();
+
 //Frees media and shuts down SDL
 void close();
 
@@ -120,6 +194,14 @@ SDL_Window* gWindow = NULL;
 //The window renderer
 SDL_Renderer* gRenderer = NULL;
 
+//Images are loaded from here when set, otherwise the built in copies are used
+std::string gAssetDir;
+
+//Startup milestones, printed once the first frame is up
+Uint64 gStartupTicks = 0;
+Uint64 gInitDoneTicks = 0;
+Uint64 gMediaDoneTicks = 0;
+
 // Load Minesweeper tiles
 SDL_Rect gTileSpriteClips[ TOTAL_BUTTONS ];
 LTexture gButtonSpriteSheetTexture;
@@ -135,6 +217,24 @@ LTexture gNumbers;
 SDL_Rect gBGBorderSpriteClips[ 16 ];
 LTexture gBGBorder;
 
+// One sprite batch per atlas
+SpriteBatch gTileBatch;
+SpriteBatch gNumberBatch;
+SpriteBatch gBorderBatch;
+
+// Whole frame cached between frames, only changed tiles are redrawn into it
+SDL_Texture* gBoardCache = NULL;
+bool gBoardCacheValid = false;
+int gCachedFlags = -1;
+
+// Main loop stage timings, F3 shows them over the board and F4 saves a trace
+FrameProfiler gProfiler;
+bool gShowProfiler = false;
+
+void drawTile(MineBoard* mineboard, int x, int y);
+void drawStats(SDL_Renderer* gRenderer , MineBoard* mineboard);
+void drawNumber( int value, int digits, int x, int y, int size, bool zeros = false );
+
 LTexture::LTexture()
 {
 	//Initialize
@@ -190,6 +290,35 @@ bool LTexture::loadFromFile( std::string path )
 	return mTexture != NULL;
 }
 
+bool LTexture::loadFromPixels( const unsigned char* pixels, int width, int height )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Upload straight to the texture, the color key is already alpha
+	SDL_Texture* newTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, width, height );
+	if( newTexture == NULL )
+	{
+		printf( "Unable to create texture! SDL Error: %s\n", SDL_GetError() );
+	}
+	else if( SDL_UpdateTexture( newTexture, NULL, pixels, width * 4 ) != 0 )
+	{
+		printf( "Unable to upload texture pixels! SDL Error: %s\n", SDL_GetError() );
+		SDL_DestroyTexture( newTexture );
+		newTexture = NULL;
+	}
+	else
+	{
+		//Blend like a color keyed surface would
+		SDL_SetTextureBlendMode( newTexture, SDL_BLENDMODE_BLEND );
+		mWidth = width;
+		mHeight = height;
+	}
+
+	mTexture = newTexture;
+	return mTexture != NULL;
+}
+
 #if defined(SDL_TTF_MAJOR_VERSION)
 bool LTexture::loadFromRenderedText( std::string textureText, SDL_Color textColor )
 {
@@ -286,6 +415,89 @@ int LTexture::getHeight()
 	return mHeight;
 }
 
+SDL_Texture* LTexture::getTexture()
+{
+	return mTexture;
+}
+
+SpriteBatch::SpriteBatch()
+{
+	mAtlas = NULL;
+}
+
+void SpriteBatch::setAtlas( LTexture* atlas, SDL_Rect* clips, int numClips )
+{
+	mAtlas = atlas;
+	mUVs.resize( numClips );
+	for( int i = 0; i < numClips; ++i )
+	{
+		mUVs[ i ].x = clips[ i ].x / (float)atlas->getWidth();
+		mUVs[ i ].y = clips[ i ].y / (float)atlas->getHeight();
+		mUVs[ i ].w = clips[ i ].w / (float)atlas->getWidth();
+		mUVs[ i ].h = clips[ i ].h / (float)atlas->getHeight();
+	}
+}
+
+void SpriteBatch::add( int clip, int x, int y, int w, int h )
+{
+	//Out of range clips draw nothing, like a clip rect off the sheet would
+	if( clip < 0 || clip >= (int)mUVs.size() )
+	{
+		return;
+	}
+	const SDL_FRect& uv = mUVs[ clip ];
+	SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+	int first = (int)mVertices.size();
+
+	//Corners clockwise from the top left
+	for( int c = 0; c < 4; ++c )
+	{
+		int right = ( c == 1 || c == 2 );
+		int bottom = ( c >= 2 );
+
+		SDL_Vertex corner;
+		corner.color = white;
+		corner.position.x = x + right * w;
+		corner.position.y = y + bottom * h;
+		corner.tex_coord.x = uv.x + right * uv.w;
+		corner.tex_coord.y = uv.y + bottom * uv.h;
+		mVertices.push_back( corner );
+	}
+
+	//Two triangles per sprite
+	mIndices.push_back( first );
+	mIndices.push_back( first + 1 );
+	mIndices.push_back( first + 2 );
+	mIndices.push_back( first );
+	mIndices.push_back( first + 2 );
+	mIndices.push_back( first + 3 );
+}
+
+void SpriteBatch::flush()
+{
+	if( !mVertices.empty() )
+	{
+		SDL_RenderGeometry( gRenderer, mAtlas->getTexture(), &mVertices[ 0 ], (int)mVertices.size(), &mIndices[ 0 ], (int)mIndices.size() );
+	}
+	//Keeps the capacity for the next frame
+	mVertices.clear();
+	mIndices.clear();
+}
+
+void setScreenSize()
+{
+	gViewCols = gBoardCols;
+	if( gViewCols < VIEW_MIN_COLS ) gViewCols = VIEW_MIN_COLS;
+	if( gViewCols > VIEW_MAX_COLS ) gViewCols = VIEW_MAX_COLS;
+	gViewRows = gBoardRows;
+	if( gViewRows > VIEW_MAX_ROWS ) gViewRows = VIEW_MAX_ROWS;
+
+	gViewWidth = MINESPRITE_SIZE*SCALING*gViewCols;
+	gViewHeight = MINESPRITE_SIZE*SCALING*gViewRows;
+
+	gScreenWidth = SCREEN_PADDING*2+gViewWidth;
+	gScreenHeight = SCREEN_PADDING*3+gViewHeight + 48*SCALING;
+}
 
 bool init()
 {
@@ -307,7 +519,7 @@ bool init()
 		}
 
 		//Create window
-		gWindow = SDL_CreateWindow( "Minesweeper", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
+		gWindow = SDL_CreateWindow( "Minesweeper", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, gScreenWidth, gScreenHeight, SDL_WINDOW_SHOWN );
 		if( gWindow == NULL )
 		{
 			printf( "Window could not be created! SDL Error: %s\n", SDL_GetError() );
@@ -316,7 +528,7 @@ bool init()
 		else
 		{
 			//Create vsynced renderer for window
-			gRenderer = SDL_CreateRenderer( gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
+			gRenderer = SDL_CreateRenderer( gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE );
 			if( gRenderer == NULL )
 			{
 				printf( "Renderer could not be created! SDL Error: %s\n", SDL_GetError() );
@@ -341,13 +553,32 @@ bool init()
 	return success;
 }
 
+bool loadImage( LTexture* texture, const char* name )
+{
+	if( !gAssetDir.empty() )
+	{
+		return texture->loadFromFile( gAssetDir + "/" + name );
+	}
+
+	for( int i = 0; i < NUM_EMBEDDED_IMAGES; ++i )
+	{
+		const EmbeddedImage& image = EMBEDDED_IMAGES[ i ];
+		if( strcmp( image.name, name ) == 0 )
+		{
+			return texture->loadFromPixels( image.pixels, image.width, image.height );
+		}
+	}
+	printf( "No built in image %s!\n", name );
+	return false;
+}
+
 bool loadMedia()
 {
 	//Loading success flag
 	bool success = true;
 
 	//Load sprites
-	if( !gButtonSpriteSheetTexture.loadFromFile( "../assets/WinmineXP.png" ) )
+	if( !loadImage( &gButtonSpriteSheetTexture, IMAGE_TILES ) )
 	{
 		printf( "Failed to load button sprite texture!\n" );
 		success = false;
@@ -362,17 +593,18 @@ bool loadMedia()
 			gTileSpriteClips[ i ].w = BUTTON_WIDTH;
 			gTileSpriteClips[ i ].h = BUTTON_HEIGHT;
 		}
+		gTileBatch.setAtlas( &gButtonSpriteSheetTexture, gTileSpriteClips, NUM_SPRITES );
     }
 
 	//Load stat background
-	if( !gStatBackground.loadFromFile( IMAGE_STAT_BG ) )
+	if( !loadImage( &gStatBackground, IMAGE_STAT_BG ) )
 	{
 		printf( "Failed to load Stats BG\n" );
 		success = false;
 	}
 
 	//Load Numbers
-	if( !gNumbers.loadFromFile( "../assets/numbers.png" ) )
+	if( !loadImage( &gNumbers, IMAGE_NUM_FONT ) )
 	{
 		printf( "Failed to load numbers sprite texture!\n" );
 		success = false;
@@ -387,11 +619,12 @@ bool loadMedia()
 			gNumbersSpriteClips[ i ].w = BUTTON_WIDTH;
 			gNumbersSpriteClips[ i ].h = BUTTON_HEIGHT;
 		}
+		gNumberBatch.setAtlas( &gNumbers, gNumbersSpriteClips, 10 );
     }
 
 	
 	//Load sprites
-	if( !gBGBorder.loadFromFile( "../assets/borders.png" ) )
+	if( !loadImage( &gBGBorder, IMAGE_BORDERS ) )
 	{
 		printf( "Failed to load border sprite texture!\n" );
 		success = false;
@@ -406,6 +639,7 @@ bool loadMedia()
 			gBGBorderSpriteClips[ i ].w = BUTTON_WIDTH;
 			gBGBorderSpriteClips[ i ].h = BUTTON_HEIGHT;
 		}
+		gBorderBatch.setAtlas( &gBGBorder, gBGBorderSpriteClips, 16 );
     }
 
 	return success;
@@ -416,6 +650,13 @@ void close()
 	//Free loaded images
 	gButtonSpriteSheetTexture.free();
 
+	//Free board cache
+	if( gBoardCache != NULL )
+	{
+		SDL_DestroyTexture( gBoardCache );
+		gBoardCache = NULL;
+	}
+
 	//Destroy window	
 	SDL_DestroyRenderer( gRenderer );
 	SDL_DestroyWindow( gWindow );
@@ -428,6 +669,97 @@ void close()
 }
 
 
+// Keep the camera over the board, a board smaller than the view sits in the top left
+void clampCamera()
+{
+	int maxX = gBoardCols*gCamera.tileSize - gViewWidth;
+	int maxY = gBoardRows*gCamera.tileSize - gViewHeight;
+	if( gCamera.x > maxX ) gCamera.x = maxX;
+	if( gCamera.y > maxY ) gCamera.y = maxY;
+	if( gCamera.x < 0 ) gCamera.x = 0;
+	if( gCamera.y < 0 ) gCamera.y = 0;
+}
+
+// Returns true if the camera moved
+bool panCamera( int dx, int dy )
+{
+	Camera old = gCamera;
+	gCamera.x += dx;
+	gCamera.y += dy;
+	clampCamera();
+	return gCamera.x != old.x || gCamera.y != old.y;
+}
+
+// Doubles or halves the tile size, keeping the board point under (px, py) of the view in place
+bool zoomCamera( int steps, int px, int py )
+{
+	int size = gCamera.tileSize;
+	if( steps > 0 && size < MAX_TILE_SIZE ) size *= 2;
+	if( steps < 0 && size > MIN_TILE_SIZE ) size /= 2;
+	if( size == gCamera.tileSize )
+	{
+		return false;
+	}
+
+	gCamera.x = (int)( (long long)( gCamera.x + px ) * size / gCamera.tileSize ) - px;
+	gCamera.y = (int)( (long long)( gCamera.y + py ) * size / gCamera.tileSize ) - py;
+	gCamera.tileSize = size;
+	clampCamera();
+	return true;
+}
+
+// Tiles at least partly inside the view, x1 and y1 exclusive
+void visibleTiles( int* x0, int* y0, int* x1, int* y1 )
+{
+	int size = gCamera.tileSize;
+	*x0 = gCamera.x / size;
+	*y0 = gCamera.y / size;
+	*x1 = ( gCamera.x + gViewWidth + size - 1 ) / size;
+	*y1 = ( gCamera.y + gViewHeight + size - 1 ) / size;
+	if( *x1 > gBoardCols ) *x1 = gBoardCols;
+	if( *y1 > gBoardRows ) *y1 = gBoardRows;
+}
+
+// Board square under window position (x, y), false when it is outside the board
+bool tileAt( int x, int y, int* tilex, int* tiley )
+{
+	if( x < SCREEN_PADDING || x >= SCREEN_PADDING + gViewWidth
+		|| y < SCREEN_PADDING || y >= SCREEN_PADDING + gViewHeight )
+	{
+		return false;
+	}
+	*tilex = ( x - SCREEN_PADDING + gCamera.x ) / gCamera.tileSize;
+	*tiley = ( y - SCREEN_PADDING + gCamera.y ) / gCamera.tileSize;
+	return *tilex < gBoardCols && *tiley < gBoardRows;
+}
+
+// Sets the viewport and clip to the board area, tiles cut by the edge are clipped
+void setBoardViewport()
+{
+	SDL_Rect boardVP = { SCREEN_PADDING, SCREEN_PADDING, gViewWidth, gViewHeight };
+	SDL_Rect clip = { 0, 0, gViewWidth, gViewHeight };
+	SDL_RenderSetViewport( gRenderer, &boardVP );
+	SDL_RenderSetClipRect( gRenderer, &clip );
+}
+
+// Draws every tile inside the view, the cost depends on the window not the board
+void drawVisibleTiles( MineBoard* mineboard )
+{
+	int x0, y0, x1, y1;
+	visibleTiles( &x0, &y0, &x1, &y1 );
+
+	setBoardViewport();
+	for( int y = y0; y < y1; y++ )
+	{
+		for( int x = x0; x < x1; x++ )
+		{
+			drawTile( mineboard, x, y );
+		}
+	}
+	gTileBatch.flush();
+	SDL_RenderSetClipRect( gRenderer, NULL );
+}
+
 void drawBoard(SDL_Renderer* gRenderer , MineBoard* mineboard) {
 
     int dest_sprite_size = MINESPRITE_SIZE*SCALING;
@@ -436,8 +768,8 @@ void drawBoard(SDL_Renderer* gRenderer , MineBoard* mineboard) {
     SDL_Rect boardVPBG;
     boardVPBG.x = 0;
     boardVPBG.y = 0;
-    boardVPBG.w = SCREEN_WIDTH;
-    boardVPBG.h = SCREEN_HEIGHT;
+    boardVPBG.w = gScreenWidth;
+    boardVPBG.h = gScreenHeight;
 
     SDL_RenderSetViewport( gRenderer, &boardVPBG );
 
@@ -450,51 +782,60 @@ void drawBoard(SDL_Renderer* gRenderer , MineBoard* mineboard) {
 	// 			0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
     //     }
     // }
+	int d = dest_sprite_size;
+	int w = gViewCols, h = gViewRows;
 	// horizontal lines
-	for (x=1; x<mineboard->getWidth()+1;x++){
+	for (x=1; x<w+1;x++){
 		// above board
-		gBGBorder.render( x*dest_sprite_size, 
-			0,  &gBGBorderSpriteClips[ BB ], 
-			0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+		gBorderBatch.add( BB, x*d, 0, d, d );
 		// below board
-		gBGBorder.render( x*dest_sprite_size, 
-			dest_sprite_size*(mineboard->getHeight()+1), &gBGBorderSpriteClips[ BTB ], 
-			0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+		gBorderBatch.add( BTB, x*d, d*(h+1), d, d );
 		// below info
-		gBGBorder.render( x*dest_sprite_size, 
-			dest_sprite_size*(mineboard->getHeight()+1+4), &gBGBorderSpriteClips[ BT ], 
-			0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+		gBorderBatch.add( BT, x*d, d*(h+1+4), d, d );
 	}
 	// vertical lines
-	for (y=0; y<mineboard->getHeight()+3+3;y++){
+	for (y=0; y<h+3+3;y++){
 		// above board
-		gBGBorder.render( 0,  
-			y*dest_sprite_size,  &gBGBorderSpriteClips[ BR ], 
-			0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+		gBorderBatch.add( BR, 0, y*d, d, d );
 		// below board
-		gBGBorder.render( (mineboard->getWidth()+1)*dest_sprite_size, 
-			y*dest_sprite_size, &gBGBorderSpriteClips[ BL ], 
-			0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+		gBorderBatch.add( BL, (w+1)*d, y*d, d, d );
 	}
 	// fill corners
 
-	gBGBorder.render( 0, 0, &gBGBorderSpriteClips[ B_NONE ], 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
-	gBGBorder.render( (mineboard->getWidth()+1)*dest_sprite_size, 0, &gBGBorderSpriteClips[ B_NONE ], 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+	gBorderBatch.add( B_NONE, 0, 0, d, d );
+	gBorderBatch.add( B_NONE, (w+1)*d, 0, d, d );
 	
-	gBGBorder.render( 0, dest_sprite_size*(mineboard->getHeight()+1), &gBGBorderSpriteClips[ B_NONE ], 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
-	gBGBorder.render( (mineboard->getWidth()+1)*dest_sprite_size, dest_sprite_size*(mineboard->getHeight()+1), &gBGBorderSpriteClips[ B_NONE ], 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+	gBorderBatch.add( B_NONE, 0, d*(h+1), d, d );
+	gBorderBatch.add( B_NONE, (w+1)*d, d*(h+1), d, d );
 	
-	gBGBorder.render( 0, (mineboard->getHeight()+3+3-1)*dest_sprite_size, &gBGBorderSpriteClips[ B_NONE ], 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
-	gBGBorder.render( (mineboard->getWidth()+1)*dest_sprite_size, (mineboard->getHeight()+3+3-1)*dest_sprite_size, &gBGBorderSpriteClips[ B_NONE ], 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+	gBorderBatch.add( B_NONE, 0, (h+3+3-1)*d, d, d );
+	gBorderBatch.add( B_NONE, (w+1)*d, (h+3+3-1)*d, d, d );
 
+	gBorderBatch.flush();
 
+	drawStats( gRenderer, mineboard );
+
+	// draw tile set
+	drawVisibleTiles( mineboard );
+}
+
+void drawTile(MineBoard* mineboard, int x, int y) {
+    int size = gCamera.tileSize;
+    int square = mineboard->showSquare(x,y);
+
+    // queued, the caller flushes gTileBatch
+    gTileBatch.add( sprite_mapping[square], x*size - gCamera.x, y*size - gCamera.y, size, size );
+}
+
+void drawStats(SDL_Renderer* gRenderer , MineBoard* mineboard) {
+    int dest_sprite_size = MINESPRITE_SIZE*SCALING;
 
 	// draw info tiles
     SDL_Rect boardVPStat;
     boardVPStat.x = SCREEN_PADDING;
-    boardVPStat.y = 2*SCREEN_PADDING + BOARD_HEIGHT;
-    boardVPStat.w = BOARD_WIDTH;
-    boardVPStat.h = BOARD_HEIGHT;
+    boardVPStat.y = 2*SCREEN_PADDING + gViewHeight;
+    boardVPStat.w = gViewWidth;
+    boardVPStat.h = gViewHeight;
 
     SDL_RenderSetViewport( gRenderer, &boardVPStat );
 
@@ -504,41 +845,167 @@ void drawBoard(SDL_Renderer* gRenderer , MineBoard* mineboard) {
 	int num_flags = mineboard->numFlags();
 	int num_mines = mineboard->numMines() - num_flags;
 
-	SDL_Rect num_flag_dest_0 = {num_flags / 10 * 16, 0, 16, 16};
-	SDL_Rect num_flag_dest_1 = {num_flags % 10 * 16, 0, 16, 16};
-	SDL_Rect num_mine_dest_0 = {num_mines / 10 * 16, 0, 16, 16};
-	SDL_Rect num_mine_dest_1 = {num_mines % 10 * 16, 0, 16, 16};
+	// The background has room for two digits each and the sprites have no
+	// minus, so more flags than mines shows 00 and counts past 99 show 99
+	int d = dest_sprite_size;
+	drawNumber( num_flags, 2, d*3, d*1, d, true );
+	drawNumber( num_mines, 2, d*7, d*1, d, true );
+	gNumberBatch.flush();
+}
 
-	gNumbers.render( dest_sprite_size*3, dest_sprite_size*1, &num_flag_dest_0, 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
-	gNumbers.render( dest_sprite_size*4, dest_sprite_size*1, &num_flag_dest_1, 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+bool createBoardCache()
+{
+	gBoardCache = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, gScreenWidth, gScreenHeight );
+	if( gBoardCache == NULL )
+	{
+		printf( "Unable to create board cache texture! SDL Error: %s\n", SDL_GetError() );
+		return false;
+	}
+	gBoardCacheValid = false;
+	return true;
+}
 
-	gNumbers.render( dest_sprite_size*7, dest_sprite_size*1, &num_mine_dest_0, 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
-	gNumbers.render( dest_sprite_size*8, dest_sprite_size*1, &num_mine_dest_1, 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
+// Bring the cached frame up to date: everything after a reset, otherwise only
+// the tiles the board reports as changed, and the stats when the flags moved
+void updateBoardCache(MineBoard* mineboard)
+{
+	SDL_SetRenderTarget( gRenderer, gBoardCache );
 
+	if( !gBoardCacheValid || mineboard->allChanged() )
+	{
+		SDL_RenderSetViewport( gRenderer, NULL );
+		SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+		SDL_RenderClear( gRenderer );
+		drawBoard( gRenderer, mineboard );
+		gBoardCacheValid = true;
+		gCachedFlags = mineboard->numFlags();
+	}
+	else
+	{
+		if( mineboard->numFlags() != gCachedFlags )
+		{
+			// blank the counters first, the digits are drawn over what was there
+			SDL_Rect statArea = { SCREEN_PADDING, 2*SCREEN_PADDING + gViewHeight, gViewWidth, 48*SCALING };
+			SDL_RenderSetViewport( gRenderer, NULL );
+			SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
+			SDL_RenderFillRect( gRenderer, &statArea );
+			drawStats( gRenderer, mineboard );
+			gCachedFlags = mineboard->numFlags();
+		}
 
-	// draw tile set
-    SDL_Rect boardVP;
-    boardVP.x = SCREEN_PADDING;
-    boardVP.y = SCREEN_PADDING;
-    boardVP.w = BOARD_WIDTH;
-    boardVP.h = BOARD_HEIGHT;
+		const std::vector<size_t>& changed = mineboard->changedCells();
+		int x0, y0, x1, y1;
+		visibleTiles( &x0, &y0, &x1, &y1 );
+		size_t visible = (size_t)( x1 - x0 ) * ( y1 - y0 );
 
+		if( changed.size() > visible )
+		{
+			// a big flood fill, redrawing the view is cheaper than walking the list
+			drawVisibleTiles( mineboard );
+		}
+		else if( !changed.empty() )
+		{
+			setBoardViewport();
+			for( size_t i = 0; i < changed.size(); i++ )
+			{
+				int x = changed[i] % mineboard->getWidth(), y = changed[i] / mineboard->getWidth();
+				if( x >= x0 && x < x1 && y >= y0 && y < y1 )
+				{
+					drawTile( mineboard, x, y );
+				}
+			}
+			gTileBatch.flush();
+			SDL_RenderSetClipRect( gRenderer, NULL );
+		}
+	}
+	mineboard->clearChanges();
 
-    SDL_RenderSetViewport( gRenderer, &boardVP );
+	SDL_SetRenderTarget( gRenderer, NULL );
+	SDL_RenderSetViewport( gRenderer, NULL );
+}
 
-    int square;
-    for (y=0; y<mineboard->getHeight();y++){
-        for (x=0; x<mineboard->getWidth();x++){
-            square = mineboard->showSquare(x,y);
+// Right aligned number from the digit sprites, clamped to what fits.
+// zeros fills all the digits, leading zeros included
+void drawNumber( int value, int digits, int x, int y, int size, bool zeros )
+{
+	int limit = 1;
+	for( int i = 0; i < digits; ++i ) limit *= 10;
+	if( value >= limit ) value = limit - 1;
+	if( value < 0 ) value = 0;
 
-            gButtonSpriteSheetTexture.render( x*dest_sprite_size, y*dest_sprite_size, &gTileSpriteClips[ sprite_mapping[square] ], 0.0, NULL, SDL_FLIP_NONE, 2.0, 2.0);
-        }
-    }
+	for( int i = digits - 1; i >= 0; --i )
+	{
+		gNumberBatch.add( value % 10, x + i*size, y, size, size );
+		value /= 10;
+		if( value == 0 && !zeros ) break;
+	}
+}
+
+// One row per stage: its colour, then p50 and p99 in microseconds
+void drawProfilerOverlay()
+{
+	static const SDL_Color stageColors[ NUM_STAGES ] = {
+		{ 0x40, 0x80, 0xFF, 0xFF }, { 0x40, 0xC0, 0x40, 0xFF }, { 0xE0, 0xE0, 0x40, 0xFF },
+		{ 0xFF, 0x90, 0x30, 0xFF }, { 0xFF, 0x40, 0x40, 0xFF }
+	};
+	int size = MINESPRITE_SIZE;
+	SDL_Rect panel = { SCREEN_PADDING, SCREEN_PADDING, size*14, size*NUM_STAGES + size };
+
+	SDL_RenderSetViewport( gRenderer, NULL );
+	SDL_SetRenderDrawBlendMode( gRenderer, SDL_BLENDMODE_BLEND );
+	SDL_SetRenderDrawColor( gRenderer, 0x00, 0x00, 0x00, 0xB0 );
+	SDL_RenderFillRect( gRenderer, &panel );
+	SDL_SetRenderDrawBlendMode( gRenderer, SDL_BLENDMODE_NONE );
+
+	for( int stage = 0; stage < NUM_STAGES; ++stage )
+	{
+		int y = panel.y + size/2 + stage*size;
+		SDL_Rect swatch = { panel.x + size/2, y + 2, size - 4, size - 4 };
+		SDL_SetRenderDrawColor( gRenderer, stageColors[ stage ].r, stageColors[ stage ].g, stageColors[ stage ].b, 0xFF );
+		SDL_RenderFillRect( gRenderer, &swatch );
+
+		drawNumber( (int)( gProfiler.percentile( stage, 0.50 ) + 0.5 ), 5, panel.x + size*2, y, size );
+		drawNumber( (int)( gProfiler.percentile( stage, 0.99 ) + 0.5 ), 5, panel.x + size*8, y, size );
+	}
+	gNumberBatch.flush();
 }
 
 int main( int argc, char* args[] )
 {
-	bool play=true, win=false,lose=false;
+	gStartupTicks = SDL_GetPerformanceCounter();
+	bool play=true;
+
+	// --no-guess only deals boards that can be cleared without guessing
+	bool no_guess = false;
+	// --continuous redraws every vsync, otherwise sleep until something happens
+	bool continuous = false;
+	// F5 saves the board to the snapshot file, F9 loads it back
+	const char* snapshot_path = "minesweeper.snap";
+	// --replay appends every finished game to a replay log
+	const char* replay_path = NULL;
+	// --pregen sets how many boards are generated ahead on a worker thread, 0 resets in place
+	int pregen = BOARDQUEUE_DEPTH;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(args[i], "--no-guess") == 0) { no_guess = true; }
+		else if (strcmp(args[i], "--continuous") == 0) { continuous = true; }
+		else if (strcmp(args[i], "-w") == 0 && i+1 < argc) { gBoardCols = atoi(args[++i]); }
+		else if (strcmp(args[i], "-h") == 0 && i+1 < argc) { gBoardRows = atoi(args[++i]); }
+		else if (strcmp(args[i], "-m") == 0 && i+1 < argc) { gBoardMines = atoi(args[++i]); }
+		else if (strcmp(args[i], "--snapshot") == 0 && i+1 < argc) { snapshot_path = args[++i]; }
+		else if (strcmp(args[i], "--replay") == 0 && i+1 < argc) { replay_path = args[++i]; }
+		else if (strcmp(args[i], "--pregen") == 0 && i+1 < argc) { pregen = atoi(args[++i]); }
+		else if (strcmp(args[i], "--assets") == 0 && i+1 < argc) { gAssetDir = args[++i]; }
+		else {
+			printf( "usage: %s [-w width] [-h height] [-m mines] [--snapshot file] [--replay file] [--pregen boards] [--assets dir] [--no-guess] [--continuous]\n", args[0] );
+			return 1;
+		}
+	}
+	if (gBoardCols < 1 || gBoardRows < 1 || gBoardMines < 0) {
+		printf( "Board needs a positive size and a non negative mine count\n" );
+		return 1;
+	}
+	setScreenSize();
+
 	//Start up SDL and create window
 	if( !init() )
 	{
@@ -546,26 +1013,69 @@ int main( int argc, char* args[] )
 	}
 	else
 	{
+		gInitDoneTicks = SDL_GetPerformanceCounter();
+
 		//Load media
-		if( !loadMedia() )
+		if( !loadMedia() || !createBoardCache() )
 		{
 			printf( "Failed to load media!\n" );
 		}
 		else
 		{	
+			gMediaDoneTicks = SDL_GetPerformanceCounter();
+
 			//Main loop flag
 			bool quit = false;
 
 			//Event handler
 			SDL_Event e;
 
-            MineBoard mineboard(NUM_WIDTH, NUM_HEIGHT, NUM_MINES);
+			MineBoard* mineboard = new MineBoard(gBoardCols, gBoardRows, gBoardMines);
+			// Clicks open regions one at a time here, index them on every deal
+			mineboard->indexOpenings(1);
+			mineboard->reset();
+			// Restarts swap in a board made on the queue's thread
+			BoardQueue* queue = NULL;
+			if (pregen > 0) {
+				queue = new BoardQueue(gBoardCols, gBoardRows, gBoardMines, pregen, 1);
+			}
+
+			NoGuessGenerator* generator = NULL;
+			bool first_click = true;
+			if (no_guess) {
+				generator = new NoGuessGenerator(gBoardCols, gBoardRows, gBoardMines);
+			}
+
+			// No-guess games are recorded from the first click, where their board is made
+			ReplayWriter replay;
+			if (generator == NULL) {
+				replay.reset(mineboard, -1, -1, SDL_GetTicks());
+			}
+
+			bool redraw = true;
+			long frames_rendered = 0;
+			long frames_skipped = 0;
 
 			//While application is running
 			while( !quit )
 			{
-				//Handle events on queue
-				while( SDL_PollEvent( &e ) != 0 )
+				//Block until an event arrives or the idle timeout passes
+				bool have_event;
+				if( continuous )
+				{
+					have_event = SDL_PollEvent( &e ) != 0;
+				}
+				else
+				{
+					have_event = SDL_WaitEventTimeout( &e, IDLE_TIMEOUT_MS ) != 0;
+				}
+				gProfiler.nextFrame();
+				//Time spent waiting is not part of any stage
+				Uint64 events_start = gProfiler.begin();
+				bool had_events = have_event;
+
+				//Handle that event and everything queued behind it, a burst becomes one frame
+				while( have_event )
 				{
 					//User requests quit
 					if( e.type == SDL_QUIT)
@@ -574,6 +1084,107 @@ int main( int argc, char* args[] )
 						quit = true;
 					}
 
+					//Render targets can lose their contents, redraw the cache
+					if( e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET )
+					{
+						gBoardCacheValid = false;
+						redraw = true;
+					}
+
+					//Exposed, resized, restored... the window needs a fresh frame
+					if( e.type == SDL_WINDOWEVENT )
+					{
+						redraw = true;
+					}
+
+					//Camera: middle drag or arrow keys pan, the wheel or +/- zoom
+					bool camera_moved = false;
+					if( e.type == SDL_MOUSEMOTION && ( e.motion.state & SDL_BUTTON_MMASK ) )
+					{
+						camera_moved = panCamera( -e.motion.xrel, -e.motion.yrel );
+					}
+					if( e.type == SDL_MOUSEWHEEL && e.wheel.y != 0 )
+					{
+						int x, y;
+						SDL_GetMouseState( &x, &y );
+						camera_moved = zoomCamera( e.wheel.y, x - SCREEN_PADDING, y - SCREEN_PADDING );
+					}
+					if( e.type == SDL_KEYDOWN )
+					{
+						switch( e.key.keysym.sym )
+						{
+							case SDLK_LEFT: camera_moved = panCamera( -PAN_STEP, 0 ); break;
+							case SDLK_RIGHT: camera_moved = panCamera( PAN_STEP, 0 ); break;
+							case SDLK_UP: camera_moved = panCamera( 0, -PAN_STEP ); break;
+							case SDLK_DOWN: camera_moved = panCamera( 0, PAN_STEP ); break;
+							case SDLK_EQUALS: camera_moved = zoomCamera( 1, gViewWidth/2, gViewHeight/2 ); break;
+							case SDLK_MINUS: camera_moved = zoomCamera( -1, gViewWidth/2, gViewHeight/2 ); break;
+						}
+					}
+					if( camera_moved )
+					{
+						gBoardCacheValid = false;
+						redraw = true;
+					}
+
+					//Profiler overlay and trace
+					if( e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F3 )
+					{
+						gShowProfiler = !gShowProfiler;
+						redraw = true;
+					}
+					if( e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F4 )
+					{
+						if( gProfiler.exportTrace( "minesweeper_trace.json" ) )
+						{
+							printf( "Trace written to minesweeper_trace.json\n" );
+						}
+						else
+						{
+							printf( "Could not write minesweeper_trace.json: %s\n", strerror( errno ) );
+						}
+					}
+
+					//Snapshots
+					if( e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F5 )
+					{
+						if( mineboard->save( snapshot_path ) != 0 )
+						{
+							printf( "Could not save %s: %s\n", snapshot_path, strerror( errno ) );
+						}
+					}
+					if( e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F9 )
+					{
+						if( mineboard->load( snapshot_path ) != 0 )
+						{
+							printf( "Could not load %s: %s\n", snapshot_path, strerror( errno ) );
+						}
+						else
+						{
+							// the snapshot may be a different size, the window stays and the camera adapts
+							bool resized = mineboard->getWidth() != gBoardCols || mineboard->getHeight() != gBoardRows || mineboard->numMines() != gBoardMines;
+							gBoardCols = mineboard->getWidth();
+							gBoardRows = mineboard->getHeight();
+							gBoardMines = mineboard->numMines();
+							if( resized && generator != NULL )
+							{
+								delete generator;
+								generator = new NoGuessGenerator(gBoardCols, gBoardRows, gBoardMines);
+							}
+							if( resized && queue != NULL )
+							{
+								queue->resize(gBoardCols, gBoardRows, gBoardMines);
+							}
+							// a loaded board did not come from a seed, it can not be replayed
+							replay.abandon();
+							clampCamera();
+							play = mineboard->status() == PLAYING;
+							first_click = false;
+							gBoardCacheValid = false;
+							redraw = true;
+						}
+					}
+
 					if(e.type == SDL_MOUSEBUTTONDOWN
 					)
 					{
@@ -581,58 +1192,129 @@ int main( int argc, char* args[] )
 					    int x, y;
 					    SDL_GetMouseState( &x, &y );
 
-						// bounds
-						if (
-							!(x < SCREEN_PADDING 
-								|| x >= SCREEN_PADDING + BOARD_WIDTH 
-								|| y < SCREEN_PADDING 
-								|| y >= SCREEN_PADDING + BOARD_HEIGHT
-							))
+						// bounds, then the square under the camera
+						int tilex, tiley;
+						if ( tileAt( x, y, &tilex, &tiley ) )
 						{
-
-							// inside
-							int tilex, tiley;
-							tilex = (x - SCREEN_PADDING) / (SCALING*MINESPRITE_SIZE);
-							tiley = (y - SCREEN_PADDING) / (SCALING*MINESPRITE_SIZE);
-							
+							Uint64 logic_start = gProfiler.begin();
 							if (play) {
 								if (e.button.button == SDL_BUTTON_LEFT) {								
-									mineboard.sweep(tilex,tiley);
+									// No-guess boards are laid out around the first click
+									if (generator != NULL && first_click) {
+										generator->generate(mineboard, tilex, tiley);
+										replay.reset(mineboard, tilex, tiley, SDL_GetTicks());
+									}
+									first_click = false;
+									int shown = mineboard->showSquare(tilex, tiley);
+									if (shown >= 1 && shown <= 8) {
+										// Chording a number, replayed as one move so a mine it opens ends the game there
+										mineboard->chord(tilex, tiley);
+										replay.chord(tilex, tiley, SDL_GetTicks());
+									}
+									else {
+										mineboard->sweep(tilex,tiley);
+										replay.sweep(tilex, tiley, SDL_GetTicks());
+									}
 								}
 								if (e.button.button == SDL_BUTTON_RIGHT) {
-									mineboard.flag(tilex, tiley);
+									mineboard->flag(tilex, tiley);
+									replay.flag(tilex, tiley, SDL_GetTicks());
 								}
 							}
 							else {
 								if (e.button.button == SDL_BUTTON_LEFT) {								
-									mineboard.reset();
+									if (queue != NULL) {
+										queue->next(&mineboard);
+									}
+									else {
+										mineboard->reset();
+									}
+									if (generator == NULL) {
+										replay.reset(mineboard, -1, -1, SDL_GetTicks());
+									}
 									play = true;
+									first_click = true;
 								}
 							}
+							gProfiler.end( STAGE_LOGIC, logic_start );
 						}
 
 					}
+
+					have_event = SDL_PollEvent( &e ) != 0;
+				}
+				if( had_events )
+				{
+					gProfiler.end( STAGE_EVENTS, events_start );
+				}
+
+				// end logic
+				Uint64 status_start = gProfiler.begin();
+				if (play && mineboard->status() != PLAYING) {
+					// TODO add text announcement on win/lose
+					// w/ "click to play again"
+					play = false;
+					replay.end(mineboard, SDL_GetTicks());
+					if (replay_path == NULL) {
+						replay.clear();
+					}
+					else if (replay.append(replay_path) != 0) {
+						printf( "Could not write %s: %s\n", replay_path, strerror( errno ) );
+					}
+					mineboard->uncover_board();
+				}
+				gProfiler.end( STAGE_STATUS, status_start );
+
+				//Anything the board changed since the last frame needs drawing
+				if( mineboard->allChanged() || !mineboard->changedCells().empty() )
+				{
+					redraw = true;
+				}
+
+				if( !continuous && !redraw )
+				{
+					frames_skipped++;
+					continue;
 				}
+				redraw = false;
+				frames_rendered++;
 
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0xFF, 0xFF, 0xFF, 0xFF );
 				SDL_RenderClear( gRenderer );
 
-                drawBoard(gRenderer, &mineboard);
+				Uint64 draw_start = gProfiler.begin();
+                updateBoardCache(mineboard);
+				SDL_RenderCopy( gRenderer, gBoardCache, NULL, NULL );
+				if( gShowProfiler )
+				{
+					drawProfilerOverlay();
+				}
+				gProfiler.end( STAGE_DRAW, draw_start );
 
 				//Update screen
+				Uint64 present_start = gProfiler.begin();
 				SDL_RenderPresent( gRenderer );
+				gProfiler.end( STAGE_PRESENT, present_start );
 
-				// end logic
-				lose = mineboard.check_lose();
-				win = mineboard.check_win();
-				if (win || lose) {
-					// TODO add text announcement on win/lose
-					// w/ "click to play again"
-					play = false;
-					mineboard.uncover_board();
+				//Time to first frame, from the top of main
+				if( frames_rendered == 1 )
+				{
+					double ms = 1000.0 / SDL_GetPerformanceFrequency();
+					printf( "Startup: init %.1f ms, media %.1f ms, first frame at %.1f ms\n",
+						( gInitDoneTicks - gStartupTicks ) * ms, ( gMediaDoneTicks - gInitDoneTicks ) * ms,
+						( SDL_GetPerformanceCounter() - gStartupTicks ) * ms );
 				}
 			}
+
+			printf( "Frames rendered: %ld, skipped: %ld\n", frames_rendered, frames_skipped );
+			if (queue != NULL) {
+				printf( "Restarts: %ld, %ld found no board ready\n", queue->numRestarts(), queue->numEmpty() );
+			}
+
+			delete queue;
+			delete mineboard;
+			delete generator;
 		}
 	}
 
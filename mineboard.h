@@ -0,0 +1,85 @@
+#ifndef MINEBOARD_H
+#define MINEBOARD_H
+
+/* libmineboard, the board engine behind a C ABI
+ *
+ * Boards are opaque handles, sizes are ints and seeds uint64_t, so any language
+ * with a C FFI can drive the engine. Nothing here throws or aborts: functions
+ * that can fail return NULL or -1.
+ *
+ * mineboard_cells hands out the board's own packed cell array, one byte per
+ * square with the MINEBOARD_CELL_* bits, so a whole board is read in place
+ * (e.g. wrapped as a numpy array) instead of square by square through
+ * mineboard_show. The bits hold the hidden state too, mines and numbers of
+ * covered squares included. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MINEBOARD_API __attribute__((visibility("default")))
+
+/* Bumped whenever a function or constant here changes meaning */
+#define MINEBOARD_ABI_VERSION 1
+
+/* Packed cell bits */
+#define MINEBOARD_CELL_ADJ_MASK 0x0F  /* adjacent mines, 0-8 */
+#define MINEBOARD_CELL_MINE 0x10
+#define MINEBOARD_CELL_FLAG 0x20
+#define MINEBOARD_CELL_COVER 0x40
+
+/* Shown values, from mineboard_show and mineboard_sweep. 0-8 are numbers */
+#define MINEBOARD_FLAG 9
+#define MINEBOARD_COVER 10
+#define MINEBOARD_MINE 11
+
+/* Game status */
+#define MINEBOARD_PLAYING 0
+#define MINEBOARD_WON 1
+#define MINEBOARD_LOST 2
+
+typedef struct mineboard mineboard;
+
+MINEBOARD_API int mineboard_abi_version(void);
+
+/* A board with its first game dealt. seed 0 picks one from the clock. Returns
+ * NULL when the size or mine count is out of range or memory runs out */
+MINEBOARD_API mineboard* mineboard_create(int width, int height, int mines, uint64_t seed);
+MINEBOARD_API void mineboard_destroy(mineboard* board);
+
+/* Deal the game with this seed, the same seed and safe square always deal the
+ * same board. The safe square and its neighbours get no mine, -1, -1 for none.
+ * Returns 0, or -1 for a safe square off the board */
+MINEBOARD_API int mineboard_reset(mineboard* board, uint64_t seed, int safe_x, int safe_y);
+
+/* Uncover a square, flood filling openings. Returns the shown value, MINEBOARD_MINE
+ * when it was a mine, MINEBOARD_FLAG for a flagged square, -1 off the board */
+MINEBOARD_API int mineboard_sweep(mineboard* board, int x, int y);
+/* Sweep count squares given as x,y pairs at once, returns how many squares it uncovered */
+MINEBOARD_API size_t mineboard_sweep_batch(mineboard* board, const int* squares, size_t count);
+/* Toggle the flag on a covered square */
+MINEBOARD_API void mineboard_flag(mineboard* board, int x, int y);
+/* Sweep the unflagged neighbours of a number with as many flags around it.
+ * Returns MINEBOARD_MINE if that uncovered a mine, -1 off the board, else 0 */
+MINEBOARD_API int mineboard_chord(mineboard* board, int x, int y);
+
+MINEBOARD_API int mineboard_status(mineboard* board);
+MINEBOARD_API int mineboard_show(mineboard* board, int x, int y);
+MINEBOARD_API int mineboard_width(mineboard* board);
+MINEBOARD_API int mineboard_height(mineboard* board);
+MINEBOARD_API int mineboard_num_mines(mineboard* board);
+MINEBOARD_API int mineboard_num_flags(mineboard* board);
+MINEBOARD_API uint64_t mineboard_seed(mineboard* board);
+
+/* Read only view of the packed cells: square x,y is cells[y*stride + x]. The
+ * pointer stays valid for the life of the board, moves change what it shows */
+MINEBOARD_API const uint8_t* mineboard_cells(mineboard* board, size_t* stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,584 @@
+// Bot server
+// Hosts many games at once for bots over a Unix domain socket (or TCP on
+// localhost) with a compact binary protocol, no SDL needed. Every thread runs
+// its own epoll loop over the connections it accepted.
+//
+// usage: server [-u path] [-p port] [-t threads] [-b squares]
+//
+// Protocol. Integers are native endian. Each request gets one response, in the
+// order the requests were sent, so a client can pipeline any number of them
+// without waiting. Requests and responses start with a 12 byte header:
+//
+//   request   u8 op, u8 flags, u16 zero, u32 game, u32 count, then the body
+//   response  u8 op, u8 result, u8 status, u8 zero, u32 game, u32 count, then count entries
+//
+//   NEW    body u32 width, u32 height, u32 mines. Starts a game with a fresh
+//          board, the response carries its id in game
+//   RESET  body u64 seed, i32 safe_x, i32 safe_y. Deals the game a new board,
+//          with that seed when flags has RESET_SEEDED, else the next of its own.
+//          safe_x, safe_y -1 for no safe square
+//   SWEEP  body count u32 squares (y*width + x), swept as one batch
+//   FLAG   body count u32 squares, the flag on each is toggled in turn
+//   CHORD  body count u32 squares, each is chorded in turn
+//   QUERY  body count u32 squares, or count 0 for the whole board
+//   CLOSE  no body, ends the game
+//
+// Response entries are u32 square << 4 | shown value (as showSquare: 0-8,
+// FLAG, COVER, MINE_VALUE), for moves only the squares they changed and for
+// QUERY the squares asked for. QUERY with count 0 instead answers with one byte
+// per square in row order. status is the game's GameStatus after the request.
+// A request with a square off the board or an out of range NEW/RESET does
+// nothing and answers RESULT_BAD_ARGUMENT, moves on a finished game do
+// nothing and answer RESULT_GAME_OVER. A NEW past the connection's game or
+// square allowance, or the server's square budget, answers RESULT_NO_ROOM.
+// Games belong to the connection that made them and end with it. An unknown op or an oversized count closes the
+// connection, the stream can not be followed past it.
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <atomic>
+#include <thread>
+
+#include <MineBoard.cpp>
+
+#define SERVER_HEADER_SIZE 12
+
+enum ServerOp
+{
+    OP_NEW = 1, OP_RESET, OP_SWEEP, OP_FLAG, OP_CHORD, OP_QUERY, OP_CLOSE
+};
+
+#define RESET_SEEDED 0x01
+
+enum ServerResult
+{
+    RESULT_OK, RESULT_NO_GAME, RESULT_BAD_ARGUMENT, RESULT_GAME_OVER, RESULT_NO_ROOM
+};
+
+// Limits, a square and its value must fit one u32 entry
+#define SERVER_MAX_SQUARES (1 << 24)
+#define SERVER_MAX_BATCH (1 << 20)
+// Per connection allowance, games open and squares over all of them
+#define SERVER_MAX_GAMES 4096
+#define SERVER_CONN_SQUARES (1 << 26)
+// Squares open over every connection, -b changes it
+#define SERVER_TOTAL_SQUARES ((long)1 << 30)
+// Stop reading from a client while this much of its output is unsent
+#define SERVER_OUT_LIMIT (8 << 20)
+// Closed games' boards kept per thread for reuse, bigger boards are freed
+#define SERVER_POOL_SIZE 256
+#define SERVER_POOL_MAX_SQUARES (1 << 16)
+#define SERVER_READ_CHUNK 65536
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) { stop_requested = 1; }
+
+// Squares of every open game, shared by the threads
+static std::atomic<long> squares_open(0);
+static long squares_budget = SERVER_TOTAL_SQUARES;
+
+struct Connection
+{
+    int fd;
+    int closing;      // set once the client left or broke the protocol
+    uint32_t events;  // what epoll watches for, EPOLLIN and EPOLLOUT
+    std::vector<unsigned char> in;   // bytes read that do not make a whole request yet
+    std::vector<unsigned char> out;  // responses not written yet, from out_start on
+    size_t out_start;
+    std::vector<MineBoard*> games;   // by id - 1, NULL once closed
+    std::vector<uint32_t> free_ids;
+    long squares;  // over the open games
+};
+
+struct ServerStats
+{
+    long connections;
+    long requests;
+    long squares;  // squares named by move and query requests
+    long changed;  // entries sent back for moves
+};
+
+class ServerThread
+{
+    public:
+    ServerThread(int listen_fd, uint64_t seed);
+    ~ServerThread();
+    void run();
+    ServerStats stats;
+
+    private:
+    void accept_all();
+    void handle_input(Connection* conn);
+    void flush(Connection* conn);
+    void watch(Connection* conn);
+    void drop(Connection* conn);
+    // Answers one request, appending the response to conn->out
+    void handle_request(Connection* conn, const unsigned char* header, const unsigned char* body);
+    // Length of the body the request at header carries, -1 if it is not valid
+    long body_size(const unsigned char* header);
+    unsigned char* respond(Connection* conn, int op, int result, MineBoard* board, uint32_t game, uint32_t count, size_t entry_size);
+    MineBoard* new_board(int width, int height, int mines);
+    // Give back a closed game's squares and keep its board for reuse if small
+    void release_board(Connection* conn, MineBoard* board);
+
+    int epoll_fd;
+    int listen_fd;
+    uint64_t seed_sequence;
+    std::vector<MineBoard*> pool;
+    std::vector<int> squares;  // x,y pairs for sweep_batch
+};
+
+static inline uint32_t get_u32(const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline void put_u32(unsigned char* p, uint32_t v) { memcpy(p, &v, 4); }
+
+ServerThread::ServerThread(int listen_fd_in, uint64_t seed)
+{
+    listen_fd = listen_fd_in;
+    seed_sequence = seed;
+    memset(&stats, 0, sizeof(stats));
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    // Only one of the threads is woken for each client that connects
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+ServerThread::~ServerThread()
+{
+    close(epoll_fd);
+    for (size_t i=0; i<pool.size(); i++) { delete pool[i]; }
+}
+
+void ServerThread::run()
+{
+    struct epoll_event events[64];
+    while (!stop_requested) {
+        int n = epoll_wait(epoll_fd, events, 64, 1000);
+        for (int i=0; i<n; i++) {
+            Connection* conn = (Connection*)events[i].data.ptr;
+            if (conn == NULL) {
+                accept_all();
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+                drop(conn);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) { flush(conn); }
+            // Requests left buffered while the output was full carry on here too
+            if (!conn->closing) { handle_input(conn); }
+            if (conn->closing) { drop(conn); }
+            else { watch(conn); }
+        }
+    }
+}
+
+void ServerThread::accept_all()
+{
+    while (1) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) { return; }  // EAGAIN, or another thread took it
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // fails harmlessly on Unix sockets
+
+        Connection* conn = new Connection();
+        conn->fd = fd;
+        conn->closing = 0;
+        conn->out_start = 0;
+        conn->squares = 0;
+        conn->events = EPOLLIN;
+        struct epoll_event event;
+        event.events = conn->events;
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            delete conn;
+            continue;
+        }
+        stats.connections++;
+    }
+}
+
+// Read what has arrived and answer every whole request in it, until the
+// output backs up. Sets conn->closing when the connection is finished
+void ServerThread::handle_input(Connection* conn)
+{
+    while (!conn->closing) {
+        // Answer every whole request buffered, while the output has room
+        size_t used = 0;
+        while (conn->out.size() - conn->out_start < SERVER_OUT_LIMIT) {
+            size_t left = conn->in.size() - used;
+            if (left < SERVER_HEADER_SIZE) { break; }
+            const unsigned char* header = conn->in.data() + used;
+            long size = body_size(header);
+            if (size < 0) {
+                conn->closing = 1;  // protocol error
+                return;
+            }
+            if (left < SERVER_HEADER_SIZE + (size_t)size) { break; }
+            handle_request(conn, header, header + SERVER_HEADER_SIZE);
+            used += SERVER_HEADER_SIZE + size;
+        }
+        conn->in.erase(conn->in.begin(), conn->in.begin() + used);
+
+        int backed_up = conn->out.size() - conn->out_start >= SERVER_OUT_LIMIT;
+        flush(conn);
+        if (conn->closing) { return; }
+        if (backed_up) {
+            // Go on with the buffered requests if the client kept up, else once it reads
+            if (conn->out.size() - conn->out_start >= SERVER_OUT_LIMIT) { return; }
+            continue;
+        }
+
+        size_t have = conn->in.size();
+        conn->in.resize(have + SERVER_READ_CHUNK);
+        ssize_t got = read(conn->fd, conn->in.data() + have, SERVER_READ_CHUNK);
+        conn->in.resize(have + (got > 0 ? got : 0));
+        if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) {
+            conn->closing = 1;  // the client is gone
+            return;
+        }
+        if (got < 0) { return; }
+    }
+}
+
+void ServerThread::flush(Connection* conn)
+{
+    while (conn->out_start < conn->out.size()) {
+        ssize_t sent = send(conn->fd, conn->out.data() + conn->out_start,
+                            conn->out.size() - conn->out_start, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN) { conn->closing = 1; }
+            return;
+        }
+        conn->out_start += sent;
+    }
+    conn->out.clear();
+    conn->out_start = 0;
+}
+
+// Watch for output room while responses are queued, and stop reading while
+// too many of them are
+void ServerThread::watch(Connection* conn)
+{
+    size_t pending = conn->out.size() - conn->out_start;
+    uint32_t events = 0;
+    if (pending < SERVER_OUT_LIMIT) { events |= EPOLLIN; }
+    if (pending > 0) { events |= EPOLLOUT; }
+    if (events == conn->events) { return; }
+    conn->events = events;
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+void ServerThread::drop(Connection* conn)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    for (size_t i=0; i<conn->games.size(); i++) {
+        if (conn->games[i] != NULL) { release_board(conn, conn->games[i]); }
+    }
+    delete conn;
+}
+
+void ServerThread::release_board(Connection* conn, MineBoard* board)
+{
+    long squares = (long)board->getWidth()*board->getHeight();
+    conn->squares -= squares;
+    squares_open -= squares;
+    if (pool.size() < SERVER_POOL_SIZE && squares <= SERVER_POOL_MAX_SQUARES) { pool.push_back(board); }
+    else { delete board; }
+}
+
+long ServerThread::body_size(const unsigned char* header)
+{
+    uint32_t count = get_u32(header + 8);
+    switch (header[0]) {
+        case OP_NEW: return 12;
+        case OP_RESET: return 16;
+        case OP_CLOSE: return 0;
+        case OP_SWEEP:
+        case OP_FLAG:
+        case OP_CHORD:
+        case OP_QUERY:
+            return count <= SERVER_MAX_BATCH ? 4*(long)count : -1;
+        default: return -1;
+    }
+}
+
+MineBoard* ServerThread::new_board(int width, int height, int mines)
+{
+    if (pool.empty()) { return new MineBoard(width, height, mines, splitmix64(&seed_sequence)); }
+    MineBoard* board = pool.back();
+    pool.pop_back();
+    try {
+        board->resize(width, height, mines);
+        board->reset(splitmix64(&seed_sequence));
+    }
+    catch (std::bad_alloc&) {
+        delete board;
+        throw;
+    }
+    return board;
+}
+
+// Append a response header with room for count entries after it, returns where the entries go
+unsigned char* ServerThread::respond(Connection* conn, int op, int result, MineBoard* board, uint32_t game, uint32_t count, size_t entry_size)
+{
+    size_t at = conn->out.size();
+    conn->out.resize(at + SERVER_HEADER_SIZE + count*entry_size);
+    unsigned char* p = conn->out.data() + at;
+    p[0] = op;
+    p[1] = result;
+    p[2] = board != NULL ? board->status() : PLAYING;
+    p[3] = 0;
+    put_u32(p + 4, game);
+    put_u32(p + 8, count);
+    return p + SERVER_HEADER_SIZE;
+}
+
+void ServerThread::handle_request(Connection* conn, const unsigned char* header, const unsigned char* body)
+{
+    int op = header[0];
+    uint32_t game = get_u32(header + 4);
+    uint32_t count = get_u32(header + 8);
+    stats.requests++;
+
+    if (op == OP_NEW) {
+        uint32_t width = get_u32(body), height = get_u32(body + 4), mines = get_u32(body + 8);
+        if (width < 1 || height < 1 || (uint64_t)width*height > SERVER_MAX_SQUARES || mines > width*height) {
+            respond(conn, op, RESULT_BAD_ARGUMENT, NULL, 0, 0, 0);
+            return;
+        }
+        // Claim the squares first, other threads claim theirs at the same time
+        long squares = (long)width*height;
+        long open = squares_open += squares;
+        if (open > squares_budget || conn->squares + squares > SERVER_CONN_SQUARES
+            || (conn->free_ids.empty() && conn->games.size() >= SERVER_MAX_GAMES)) {
+            squares_open -= squares;
+            respond(conn, op, RESULT_NO_ROOM, NULL, 0, 0, 0);
+            return;
+        }
+        MineBoard* board;
+        try {
+            board = new_board((int)width, (int)height, (int)mines);
+        }
+        catch (std::bad_alloc&) {
+            squares_open -= squares;
+            respond(conn, op, RESULT_NO_ROOM, NULL, 0, 0, 0);
+            return;
+        }
+        conn->squares += squares;
+        uint32_t id;
+        if (!conn->free_ids.empty()) {
+            id = conn->free_ids.back();
+            conn->free_ids.pop_back();
+        }
+        else {
+            conn->games.push_back(NULL);
+            id = (uint32_t)conn->games.size();
+        }
+        board->clearChanges();
+        conn->games[id-1] = board;
+        respond(conn, op, RESULT_OK, board, id, 0, 0);
+        return;
+    }
+
+    MineBoard* board = game >= 1 && game <= conn->games.size() ? conn->games[game-1] : NULL;
+    if (board == NULL) {
+        respond(conn, op, RESULT_NO_GAME, NULL, game, 0, 0);
+        return;
+    }
+    int width = board->getWidth();
+    uint32_t cells = (uint32_t)width*board->getHeight();
+
+    if (op == OP_CLOSE) {
+        conn->games[game-1] = NULL;
+        conn->free_ids.push_back(game);
+        release_board(conn, board);
+        respond(conn, op, RESULT_OK, NULL, game, 0, 0);
+        return;
+    }
+
+    if (op == OP_RESET) {
+        uint64_t seed;
+        int32_t safe_x, safe_y;
+        memcpy(&seed, body, 8);
+        memcpy(&safe_x, body + 8, 4);
+        memcpy(&safe_y, body + 12, 4);
+        int no_safe = safe_x == -1 && safe_y == -1;
+        if (!no_safe && (safe_x < 0 || safe_y < 0 || safe_x >= width || safe_y >= board->getHeight())) {
+            respond(conn, op, RESULT_BAD_ARGUMENT, board, game, 0, 0);
+            return;
+        }
+        if (header[1] & RESET_SEEDED) { board->reset(seed, safe_x, safe_y); }
+        else { board->reset(safe_x, safe_y); }
+        board->clearChanges();
+        respond(conn, op, RESULT_OK, board, game, 0, 0);
+        return;
+    }
+
+    // The rest name squares, all of them must be on the board
+    for (uint32_t i=0; i<count; i++) {
+        if (get_u32(body + 4*i) >= cells) {
+            respond(conn, op, RESULT_BAD_ARGUMENT, board, game, 0, 0);
+            return;
+        }
+    }
+    stats.squares += count;
+
+    if (op == OP_QUERY) {
+        if (count == 0) {
+            unsigned char* out = respond(conn, op, RESULT_OK, board, game, cells, 1);
+            for (int y=0; y<board->getHeight(); y++) {
+                for (int x=0; x<width; x++) { *out++ = (unsigned char)board->showSquare(x, y); }
+            }
+            return;
+        }
+        unsigned char* out = respond(conn, op, RESULT_OK, board, game, count, 4);
+        for (uint32_t i=0; i<count; i++) {
+            uint32_t square = get_u32(body + 4*i);
+            put_u32(out + 4*i, square << 4 | board->showSquare(square % width, square / width));
+        }
+        return;
+    }
+
+    if (board->status() != PLAYING) {
+        respond(conn, op, RESULT_GAME_OVER, board, game, 0, 0);
+        return;
+    }
+
+    board->clearChanges();
+    if (op == OP_SWEEP) {
+        squares.resize(2*(size_t)count);
+        for (uint32_t i=0; i<count; i++) {
+            uint32_t square = get_u32(body + 4*i);
+            squares[2*i] = square % width;
+            squares[2*i+1] = square / width;
+        }
+        board->sweep_batch(squares.data(), count);
+    }
+    else {
+        for (uint32_t i=0; i<count; i++) {
+            uint32_t square = get_u32(body + 4*i);
+            if (op == OP_FLAG) { board->flag(square % width, square / width); }
+            else { board->chord(square % width, square / width); }
+        }
+    }
+
+    // Only what the moves changed goes back, a flag toggled twice is listed twice
+    const std::vector<size_t>& changes = board->changedCells();
+    unsigned char* out = respond(conn, op, RESULT_OK, board, game, (uint32_t)changes.size(), 4);
+    for (size_t i=0; i<changes.size(); i++) {
+        uint32_t square = (uint32_t)changes[i];
+        put_u32(out + 4*i, square << 4 | board->showSquare(square % width, square / width));
+    }
+    stats.changed += changes.size();
+    board->clearChanges();
+}
+
+void usage()
+{
+    printf("usage: server [-u path] [-p port] [-t threads] [-b squares]\n");
+    printf("  -u path     listen on a Unix domain socket (default minesweeper.sock)\n");
+    printf("  -p port     listen on TCP 127.0.0.1:port instead\n");
+    printf("  -b squares  squares of all open games together (default %ld)\n", SERVER_TOTAL_SQUARES);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* path = "minesweeper.sock";
+    int port = 0;
+    int threads = (int)std::thread::hardware_concurrency();
+    for (int i=1; i<argc; i++) {
+        if (i+1 >= argc) { usage(); return 1; }
+        if (strcmp(argv[i], "-u") == 0) { path = argv[++i]; }
+        else if (strcmp(argv[i], "-p") == 0) { port = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "-t") == 0) { threads = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "-b") == 0) { squares_budget = atol(argv[++i]); }
+        else { usage(); return 1; }
+    }
+    if (threads < 1) { threads = 1; }
+
+    int listen_fd;
+    if (port > 0) {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("bind");
+            return 1;
+        }
+    }
+    else {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            printf("Socket path too long: %s\n", path);
+            return 1;
+        }
+        strcpy(addr.sun_path, path);
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        unlink(path);  // left behind by a server that did not exit cleanly
+        if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("bind");
+            return 1;
+        }
+    }
+    if (listen(listen_fd, SOMAXCONN) < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    if (port > 0) { printf("Listening on 127.0.0.1:%d with %d threads\n", port, threads); }
+    else { printf("Listening on %s with %d threads\n", path, threads); }
+    fflush(stdout);
+
+    // Every thread deals boards from its own seed sequence
+    uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    std::vector<ServerThread*> workers;
+    std::vector<std::thread> running;
+    for (int t=0; t<threads; t++) { workers.push_back(new ServerThread(listen_fd, splitmix64(&seed))); }
+    for (int t=0; t<threads; t++) { running.push_back(std::thread(&ServerThread::run, workers[t])); }
+    for (int t=0; t<threads; t++) { running[t].join(); }
+
+    ServerStats total;
+    memset(&total, 0, sizeof(total));
+    for (int t=0; t<threads; t++) {
+        total.connections += workers[t]->stats.connections;
+        total.requests += workers[t]->stats.requests;
+        total.squares += workers[t]->stats.squares;
+        total.changed += workers[t]->stats.changed;
+        delete workers[t];
+    }
+    close(listen_fd);
+    if (port <= 0) { unlink(path); }
+    printf("Served %ld requests naming %ld squares on %ld connections, %ld changed squares sent\n",
+           total.requests, total.squares, total.connections, total.changed);
+    return 0;
+}
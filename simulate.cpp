@@ -0,0 +1,488 @@
+// Headless batch simulator
+// Plays many games with a pluggable strategy across all cores, no SDL needed.
+//
+// usage: simulate [-w width] [-h height] [-m mines] [-g games] [-t threads] [-s strategy] [-n] [-r prefix]
+
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <MineBoard.cpp>
+#include <MineSolver.cpp>
+#include <MineProbability.cpp>
+#include <NoGuess.cpp>
+#include <Replay.cpp>
+
+#define MOVE_SWEEP 0
+#define MOVE_FLAG 1
+
+// Games handed out per task, small enough to keep every worker busy until the end
+#define GAMES_PER_TASK 64
+// Give up on a game after this many moves, guards against a strategy that stalls
+#define MAX_MOVES_FACTOR 4
+
+// Latency histogram, 8 sub buckets per power of two of nanoseconds
+#define LATENCY_SUB_BITS 3
+#define LATENCY_BUCKETS (64 << LATENCY_SUB_BITS)
+
+struct Move
+{
+    int x, y;
+    int action;
+};
+
+// Small fast PRNG for strategies, one per worker
+struct XorShift
+{
+    uint64_t state;
+    XorShift(uint64_t seed) { state = seed ? seed : 0x9E3779B97F4A7C15ull; }
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    int below(int n) { return (int)((next() >> 32) * (uint64_t)n >> 32); }
+};
+
+class Strategy
+{
+    public:
+    virtual ~Strategy() {}
+    virtual void new_game(MineBoard*) {}
+    // Pick the next move, x < 0 gives up on the game
+    virtual Move next_move(MineBoard* board) = 0;
+};
+
+// Sweeps a random covered square every move
+class RandomStrategy : public Strategy
+{
+    public:
+    RandomStrategy(uint64_t seed) : rng(seed) {}
+    Move next_move(MineBoard* board) {
+        Move move = {0, 0, MOVE_SWEEP};
+        do {
+            move.x = rng.below(board->getWidth());
+            move.y = rng.below(board->getHeight());
+        } while (board->showSquare(move.x, move.y) != COVER);
+        return move;
+    }
+
+    private:
+    XorShift rng;
+};
+
+// Sweeps whatever the constraint solver proves safe, guesses at random otherwise
+class SolverStrategy : public Strategy
+{
+    public:
+    SolverStrategy(uint64_t seed) : rng(seed), solver(NULL) {}
+    ~SolverStrategy() { delete solver; }
+
+    void new_game(MineBoard* board) {
+        if (solver == NULL) { solver = new MineSolver(board->getWidth(), board->getHeight()); }
+        solver->reset();
+        board->clearChanges();
+        first_move = 1;
+    }
+
+    Move next_move(MineBoard* board) {
+        Move move = {0, 0, MOVE_SWEEP};
+        if (first_move) {
+            // Open in the middle, the most likely place for an opening
+            first_move = 0;
+            move.x = board->getWidth() / 2;
+            move.y = board->getHeight() / 2;
+            return move;
+        }
+
+        solver->update(board);
+        if (solver->nextSafe(&move.x, &move.y)) { return move; }
+
+        do {
+            move.x = rng.below(board->getWidth());
+            move.y = rng.below(board->getHeight());
+        } while (!solver->isUnknown(move.x, move.y) || board->showSquare(move.x, move.y) != COVER);
+        return move;
+    }
+
+    private:
+    XorShift rng;
+    MineSolver* solver;
+    int first_move;
+};
+
+// Like the solver strategy, but guesses the square least likely to be a mine
+class ProbabilityStrategy : public Strategy
+{
+    public:
+    ProbabilityStrategy() : solver(NULL), probability(NULL) {}
+    ~ProbabilityStrategy() { delete solver; delete probability; }
+
+    void new_game(MineBoard* board) {
+        if (solver == NULL) {
+            solver = new MineSolver(board->getWidth(), board->getHeight());
+            probability = new MineProbability(board->getWidth(), board->getHeight());
+            // the simulator already runs a game per core
+            probability->setThreads(1);
+        }
+        solver->reset();
+        board->clearChanges();
+        first_move = 1;
+    }
+
+    Move next_move(MineBoard* board) {
+        Move move = {0, 0, MOVE_SWEEP};
+        if (first_move) {
+            first_move = 0;
+            move.x = board->getWidth() / 2;
+            move.y = board->getHeight() / 2;
+            return move;
+        }
+
+        solver->update(board);
+        if (solver->nextSafe(&move.x, &move.y)) { return move; }
+
+        probability->compute(board);
+        if (!probability->safest(board, &move.x, &move.y)) { move.x = -1; }
+        return move;
+    }
+
+    private:
+    MineSolver* solver;
+    MineProbability* probability;
+    int first_move;
+};
+
+Strategy* make_strategy(const char* name, uint64_t seed)
+{
+    if (strcmp(name, "random") == 0) { return new RandomStrategy(seed); }
+    if (strcmp(name, "solver") == 0) { return new SolverStrategy(seed); }
+    if (strcmp(name, "prob") == 0) { return new ProbabilityStrategy(); }
+    return NULL;
+}
+
+struct WorkerStats
+{
+    long games;
+    long wins;
+    long moves;
+    long fallbacks;
+    long latency[LATENCY_BUCKETS];
+};
+
+int latency_bucket(uint64_t ns)
+{
+    if (ns < (1 << LATENCY_SUB_BITS)) { return (int)ns; }
+    int top = 63 - __builtin_clzll(ns);
+    int sub = (int)(ns >> (top - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+    return ((top - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+// Lower edge of a bucket in nanoseconds
+double latency_value(int bucket)
+{
+    if (bucket < (1 << LATENCY_SUB_BITS)) { return bucket; }
+    int top = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    int sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+    return ldexp(1.0 + sub / (double)(1 << LATENCY_SUB_BITS), top);
+}
+
+double latency_percentile(const long* latency, long total, double p)
+{
+    long target = (long)ceil(p * total);
+    long seen = 0;
+    for (int i=0; i<LATENCY_BUCKETS; i++) {
+        seen += latency[i];
+        if (seen >= target && seen > 0) { return latency_value(i); }
+    }
+    return 0;
+}
+
+// Work stealing pool, each worker owns a deque of tasks (a task is a number of games)
+// and steals from the front of the others once its own runs dry
+class WorkPool
+{
+    public:
+    WorkPool(int num_workers) : queues(num_workers), locks(num_workers) {}
+
+    void push(int worker, int task) {
+        std::lock_guard<std::mutex> guard(locks[worker]);
+        queues[worker].push_back(task);
+    }
+
+    // Returns false once every queue is empty
+    bool pop(int worker, int* task) {
+        int n = (int)queues.size();
+        for (int i=0; i<n; i++) {
+            int victim = (worker + i) % n;
+            std::lock_guard<std::mutex> guard(locks[victim]);
+            if (queues[victim].empty()) { continue; }
+            if (victim == worker) {
+                *task = queues[victim].back();
+                queues[victim].pop_back();
+            }
+            else {
+                *task = queues[victim].front();
+                queues[victim].pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    private:
+    std::vector<std::deque<int> > queues;
+    std::vector<std::mutex> locks;
+};
+
+struct SimConfig
+{
+    int width, height, mines;
+    long games;
+    int threads;
+    const char* strategy;
+    int no_guess;
+    const char* replay_prefix;  // NULL for no replays
+};
+
+// Millisecond clock for replay logs
+uint32_t replay_ms()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void play_games(MineBoard* board, Strategy* strategy, NoGuessGenerator* generator,
+    int count, WorkerStats* stats, ReplayWriter* replay)
+{
+    long max_moves = (long)board->getWidth() * board->getHeight() * MAX_MOVES_FACTOR;
+
+    for (int g=0; g<count; g++) {
+        // Strategies open in the middle
+        if (generator == NULL) { board->reset(); }
+        else if (!generator->generate(board, board->getWidth() / 2, board->getHeight() / 2)) {
+            stats->fallbacks++;
+        }
+        if (replay != NULL) {
+            if (generator == NULL) { replay->reset(board, -1, -1, replay_ms()); }
+            else { replay->reset(board, board->getWidth() / 2, board->getHeight() / 2, replay_ms()); }
+        }
+        strategy->new_game(board);
+
+        long moves = 0;
+        while (board->status() == PLAYING && moves < max_moves) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            Move move = strategy->next_move(board);
+            if (move.x < 0) { break; }
+            if (move.action == MOVE_FLAG) { board->flag(move.x, move.y); }
+            else { board->sweep(move.x, move.y); }
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            if (replay != NULL) {
+                if (move.action == MOVE_FLAG) { replay->flag(move.x, move.y, replay_ms()); }
+                else { replay->sweep(move.x, move.y, replay_ms()); }
+            }
+
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            stats->latency[latency_bucket(ns)]++;
+            moves++;
+        }
+
+        if (replay != NULL) { replay->end(board, replay_ms()); }
+        stats->games++;
+        stats->moves += moves;
+        if (board->status() == WON) { stats->wins++; }
+    }
+}
+
+void worker_main(int id, SimConfig* config, WorkPool* pool, WorkerStats* stats)
+{
+    MineBoard board(config->width, config->height, config->mines);
+    Strategy* strategy = make_strategy(config->strategy, 0x2545F4914F6CDD1Dull * (id + 1));
+    // Every core already runs a game, so each generator races on one thread
+    NoGuessGenerator* generator = NULL;
+    if (config->no_guess) { generator = new NoGuessGenerator(config->width, config->height, config->mines, 1); }
+
+    // Each worker appends its games to its own file
+    ReplayWriter* replay = NULL;
+    char replay_path[4096];
+    if (config->replay_prefix != NULL) {
+        replay = new ReplayWriter();
+        snprintf(replay_path, sizeof(replay_path), "%s.%d.rpl", config->replay_prefix, id);
+    }
+
+    int task;
+    while (pool->pop(id, &task)) {
+        play_games(&board, strategy, generator, task, stats, replay);
+        if (replay != NULL && replay->append(replay_path) != 0) {
+            fprintf(stderr, "%s: %s\n", replay_path, strerror(errno));
+        }
+    }
+    delete replay;
+    delete strategy;
+    delete generator;
+}
+
+// Times the probability engine on positions where the solver has run out of safe moves
+int bench_probability(SimConfig* config, long evaluations)
+{
+    MineBoard board(config->width, config->height, config->mines);
+    MineSolver solver(config->width, config->height);
+    MineProbability probability(config->width, config->height);
+    probability.setThreads(config->threads);
+
+    // Collect positions to replay, one per game
+    std::vector<MineBoard*> positions;
+    int wanted = 64, attempts = 0;
+    while ((int)positions.size() < wanted && attempts++ < wanted*100) {
+        MineBoard* position = new MineBoard(config->width, config->height, config->mines);
+        solver.reset();
+        position->sweep(config->width / 2, config->height / 2);
+        int x, y;
+        while (position->status() == PLAYING) {
+            solver.update(position);
+            if (!solver.nextSafe(&x, &y)) { break; }
+            position->sweep(x, y);
+        }
+        if (position->status() == PLAYING) { positions.push_back(position); }
+        else { delete position; }
+    }
+    if (positions.empty()) {
+        printf("No undecided positions found\n");
+        return 1;
+    }
+
+    int exact = 0;
+    long components = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i=0; i<evaluations; i++) {
+        MineBoard* position = positions[i % positions.size()];
+        exact += probability.compute(position);
+        components += probability.numComponents();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("board       %dx%d, %d mines, %d threads\n", config->width, config->height, config->mines, config->threads);
+    printf("positions   %d, %.1f frontier components on average\n", (int)positions.size(),
+        components / (double)evaluations);
+    printf("evaluations %ld in %.3f s (%.0f evaluations/s, %.1f us each)\n", evaluations, seconds,
+        evaluations / seconds, 1e6 * seconds / evaluations);
+    printf("exact       %.2f%%\n", 100.0 * exact / evaluations);
+
+    for (size_t i=0; i<positions.size(); i++) { delete positions[i]; }
+    return 0;
+}
+
+void usage()
+{
+    printf("usage: simulate [-w width] [-h height] [-m mines] [-g games] [-t threads] [-s strategy] [-n]\n");
+    printf("       simulate [-w width] [-h height] [-m mines] -P evaluations\n");
+    printf("strategies: random, solver, prob\n");
+    printf("-n plays no-guess boards\n");
+    printf("-r prefix records every game to prefix.<thread>.rpl, check them with verify\n");
+}
+
+int main(int argc, char* argv[])
+{
+    SimConfig config;
+    long prob_evaluations = 0;
+    config.width = 30;
+    config.height = 16;
+    config.mines = 99;
+    config.games = 1000000;
+    config.threads = (int)std::thread::hardware_concurrency();
+    config.strategy = "random";
+    config.no_guess = 0;
+    config.replay_prefix = NULL;
+    if (config.threads < 1) { config.threads = 1; }
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-n") == 0) { config.no_guess = 1; continue; }
+        if (i+1 >= argc) { usage(); return 1; }
+        if (strcmp(argv[i], "-w") == 0) { config.width = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "-h") == 0) { config.height = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "-m") == 0) { config.mines = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "-g") == 0) { config.games = atol(argv[++i]); }
+        else if (strcmp(argv[i], "-t") == 0) { config.threads = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "-s") == 0) { config.strategy = argv[++i]; }
+        else if (strcmp(argv[i], "-P") == 0) { prob_evaluations = atol(argv[++i]); }
+        else if (strcmp(argv[i], "-r") == 0) { config.replay_prefix = argv[++i]; }
+        else { usage(); return 1; }
+    }
+
+    Strategy* check = make_strategy(config.strategy, 1);
+    if (check == NULL) {
+        printf("Unknown strategy %s\n", config.strategy);
+        usage();
+        return 1;
+    }
+    delete check;
+
+    if (config.width < 1 || config.height < 1 || config.threads < 1 || config.mines < 0
+        || config.mines >= config.width*config.height) {
+        printf("Invalid board or thread count\n");
+        return 1;
+    }
+
+    if (prob_evaluations > 0) { return bench_probability(&config, prob_evaluations); }
+
+    // Deal the games out round robin, stealing evens out the rest
+    WorkPool pool(config.threads);
+    long remaining = config.games;
+    for (int i=0; remaining > 0; i++) {
+        int task = remaining < GAMES_PER_TASK ? (int)remaining : GAMES_PER_TASK;
+        pool.push(i % config.threads, task);
+        remaining -= task;
+    }
+
+    std::vector<WorkerStats> stats(config.threads);
+    memset(stats.data(), 0, sizeof(WorkerStats) * config.threads);
+    std::vector<std::thread> workers;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i=0; i<config.threads; i++) {
+        workers.push_back(std::thread(worker_main, i, &config, &pool, &stats[i]));
+    }
+    for (int i=0; i<config.threads; i++) {
+        workers[i].join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Merge results
+    WorkerStats total;
+    memset(&total, 0, sizeof(total));
+    for (int i=0; i<config.threads; i++) {
+        total.games += stats[i].games;
+        total.wins += stats[i].wins;
+        total.moves += stats[i].moves;
+        total.fallbacks += stats[i].fallbacks;
+        for (int b=0; b<LATENCY_BUCKETS; b++) { total.latency[b] += stats[i].latency[b]; }
+    }
+
+    // Wilson score interval at 95%
+    double n = total.games > 0 ? (double)total.games : 1.0;
+    double p = total.wins / n;
+    double z = 1.96;
+    double centre = (p + z*z/(2*n)) / (1 + z*z/n);
+    double spread = z * sqrt(p*(1-p)/n + z*z/(4*n*n)) / (1 + z*z/n);
+
+    printf("board       %dx%d, %d mines (%.1f%%)\n", config.width, config.height, config.mines,
+        100.0 * config.mines / ((double)config.width*config.height));
+    printf("strategy    %s, %d threads\n", config.strategy, config.threads);
+    if (config.no_guess) {
+        printf("no-guess    %ld boards fell back to a safe start\n", total.fallbacks);
+    }
+    printf("games       %ld in %.3f s (%.0f games/s)\n", total.games, seconds, total.games / seconds);
+    printf("win rate    %.4f%% (95%% CI %.4f%% - %.4f%%)\n", 100*p, 100*(centre-spread), 100*(centre+spread));
+    printf("moves       %ld (%.1f per game)\n", total.moves, total.moves / n);
+    printf("move ns     p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f\n",
+        latency_percentile(total.latency, total.moves, 0.50),
+        latency_percentile(total.latency, total.moves, 0.90),
+        latency_percentile(total.latency, total.moves, 0.99),
+        latency_percentile(total.latency, total.moves, 0.999));
+
+    return 0;
+}
@@ -0,0 +1,306 @@
+// Engine regression tests, run by meson test
+//
+// Each test returns the number of checks that failed. No SDL needed.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <MineBoard.cpp>
+#include <InfiniteMineBoard.cpp>
+#include <Replay.cpp>
+#include <libmineboard.cpp>
+
+#define CHECK(cond) \
+    do { if (!(cond)) { printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// Find a covered square next to (x, y) that is a mine (want_mine) or not,
+// starting after raster position from. Returns its index in the 3x3 block, -1 if none
+static int covered_neighbour(MineBoard* board, int x, int y, int want_mine, int from)
+{
+    for (int i = from + 1; i < 9; i++) {
+        int sx = x + i%3 - 1, sy = y + i/3 - 1;
+        if (sx < 0 || sy < 0 || sx >= board->getWidth() || sy >= board->getHeight() || i == 4) { continue; }
+        if (board->showSquare(sx, sy) == COVER && board->is_mine(sx, sy) == want_mine) { return i; }
+    }
+    return -1;
+}
+
+// A chord that a wrong flag makes open a mine ahead of other squares must
+// verify as the lost game it was, not as moves made after the loss
+int test_replay_lost_chord()
+{
+    int failures = 0;
+    MineBoard board(30, 16, 99, 1);
+    for (uint64_t seed = 1; seed < 10000; seed++) {
+        board.reset(seed, 15, 8);
+        board.sweep(15, 8);
+        // A 1 with a covered mine before a covered safe square, and another
+        // covered safe square to put the wrong flag on
+        int nx = -1, ny = -1, wrong = -1;
+        for (int y = 0; y < 16 && nx < 0; y++) {
+            for (int x = 0; x < 30 && nx < 0; x++) {
+                if (board.showSquare(x, y) != 1) { continue; }
+                int mine = covered_neighbour(&board, x, y, 1, -1);
+                if (mine < 0 || covered_neighbour(&board, x, y, 0, mine) < 0) { continue; }
+                wrong = covered_neighbour(&board, x, y, 0, -1);
+                if (wrong >= 0 && wrong < mine) { nx = x, ny = y; }
+            }
+        }
+        if (nx < 0) { continue; }
+
+        ReplayWriter writer;
+        writer.reset(&board, 15, 8, 0);
+        writer.sweep(15, 8, 10);
+        board.flag(nx + wrong%3 - 1, ny + wrong/3 - 1);
+        writer.flag(nx + wrong%3 - 1, ny + wrong/3 - 1, 20);
+        board.chord(nx, ny);
+        writer.chord(nx, ny, 30);
+        CHECK(board.status() == LOST);
+        writer.end(&board, 40);
+
+        std::vector<unsigned char> file(REPLAY_MAGIC, REPLAY_MAGIC + 4);
+        file.push_back(REPLAY_VERSION);
+        file.insert(file.end(), writer.data().begin(), writer.data().end());
+        ReplayStats stats;
+        memset(&stats, 0, sizeof(stats));
+        ReplayVerifier verifier;
+        verifier.verify(file.data(), file.size(), &stats);
+        CHECK(stats.games == 1);
+        CHECK(stats.verified == 1);
+        CHECK(stats.illegal == 0);
+        return failures;
+    }
+    printf("  no board with a losing chord found\n");
+    return failures + 1;
+}
+
+// A RESET asking for more than REPLAY_MAX_SQUARES is refused before any allocation
+int test_replay_oversized_reset()
+{
+    int failures = 0;
+    // width and height 32768 as varints, 10 mines, seed 1, no safe square
+    unsigned char file[] = { 'M', 'S', 'R', 'P', REPLAY_VERSION, REPLAY_RESET,
+                             0x80, 0x80, 0x02, 0x80, 0x80, 0x02, 10, 1, 0, 0 };
+    ReplayStats stats;
+    memset(&stats, 0, sizeof(stats));
+    ReplayVerifier verifier;
+    verifier.verify(file, sizeof(file), &stats);
+    CHECK(stats.malformed == 1);
+    CHECK(stats.games == 0);
+    return failures;
+}
+
+// Overwrite size bytes of the file at offset
+static void patch(const char* path, size_t offset, const void* bytes, size_t size)
+{
+    int fd = open(path, O_WRONLY);
+    if (fd >= 0) {
+        if (pwrite(fd, bytes, size, offset) != (ssize_t)size) { perror("pwrite"); }
+        close(fd);
+    }
+}
+
+// A snapshot whose header counters disagree with its cells loads with the
+// counters taken from the cells, and impossible cell bytes are refused
+int test_snapshot_tampered()
+{
+    int failures = 0;
+    const char* path = "tests_snapshot.tmp";
+    MineBoard board(30, 16, 99, 2);
+    board.reset(7, 15, 8);
+    board.sweep(15, 8);
+    for (int x = 0; x < 30; x++) {
+        if (board.showSquare(x, 0) == COVER) { board.flag(x, 0); }
+    }
+    GameStatus status = board.status();
+    int flags = board.numFlags();
+    CHECK(board.save(path) == 0);
+
+    // Counters claiming a nearly won game with no flags
+    uint64_t covered = 1;
+    int32_t zero = 0, mines = 3;
+    patch(path, offsetof(BoardSnapshotHeader, covered_safe), &covered, sizeof(covered));
+    patch(path, offsetof(BoardSnapshotHeader, num_flags), &zero, sizeof(zero));
+    patch(path, offsetof(BoardSnapshotHeader, num_mines), &mines, sizeof(mines));
+    MineBoard loaded(1, 1, 0, 1);
+    CHECK(loaded.load(path) == 0);
+    CHECK(loaded.numMines() == 99);
+    CHECK(loaded.numFlags() == flags);
+    CHECK(loaded.status() == status);
+    // Sweeping one more safe square must not win it
+    for (int i = 0; i < 30*16; i++) {
+        if (loaded.showSquare(i % 30, i / 30) == COVER && !loaded.is_mine(i % 30, i / 30)) {
+            loaded.sweep(i % 30, i / 30);
+            break;
+        }
+    }
+    CHECK(loaded.status() == PLAYING);
+
+    // Cell bytes the engine never makes are refused and leave the board as it was
+    unsigned char cells[3] = { 9, CELL_FLAG | 1, 0x80 | CELL_COVER };
+    for (int i = 0; i < 3; i++) {
+        CHECK(board.save(path) == 0);
+        patch(path, sizeof(BoardSnapshotHeader) + 100, &cells[i], 1);
+        errno = 0;
+        CHECK(loaded.load(path) == -1 && errno == EINVAL);
+        CHECK(loaded.getWidth() == 30 && loaded.status() == PLAYING);
+    }
+
+    // A lost game with no mine uncovered
+    CHECK(board.save(path) == 0);
+    int32_t one = 1;
+    patch(path, offsetof(BoardSnapshotHeader, mine_revealed), &one, sizeof(one));
+    CHECK(loaded.load(path) == -1 && errno == EINVAL);
+
+    // A lost game uncovered at the end, as the game saves it, still loads lost
+    for (int i = 0; i < 30*16; i++) {
+        if (board.is_mine(i % 30, i / 30) && board.showSquare(i % 30, i / 30) == COVER) {
+            board.sweep(i % 30, i / 30);
+            break;
+        }
+    }
+    board.uncover_board();
+    CHECK(board.save(path) == 0);
+    CHECK(loaded.load(path) == 0);
+    CHECK(loaded.status() == LOST);
+
+    unlink(path);
+    return failures;
+}
+
+// mineboard_create returns NULL and resize throws rather than crashing when
+// the board does not fit in memory. Runs in a child with its address space capped
+int test_create_out_of_memory()
+{
+    int failures = 0;
+#if defined(__SANITIZE_ADDRESS__)
+    // The sanitizer's shadow memory does not fit under the cap
+    return failures;
+#endif
+    pid_t child = fork();
+    if (child == 0) {
+        struct rlimit limit;
+        limit.rlim_cur = limit.rlim_max = (rlim_t)256 << 20;
+        if (setrlimit(RLIMIT_AS, &limit) != 0) { _exit(2); }
+        // 2^30 squares, allowed by the size limits but a gigabyte of cells alone
+        mineboard* board = mineboard_create(1 << 15, 1 << 15, 10, 1);
+        if (board != NULL) { _exit(1); }
+        // A resize that does not fit leaves the board playable at its old size
+        MineBoard small(9, 9, 10, 1);
+        int threw = 0;
+        try {
+            small.resize(1 << 15, 1 << 15, 10);
+        }
+        catch (std::bad_alloc&) {
+            threw = 1;
+        }
+        small.reset(3, 4, 4);
+        _exit(threw && small.getWidth() == 9 && small.sweep(4, 4) == 0 ? 0 : 3);
+    }
+    int status = 0;
+    CHECK(child > 0 && waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // A board that fits still works
+    mineboard* board = mineboard_create(9, 9, 10, 1);
+    CHECK(board != NULL);
+    if (board != NULL) {
+        size_t stride = 0;
+        CHECK(mineboard_cells(board, &stride) != NULL && stride == 9);
+        mineboard_destroy(board);
+    }
+    return failures;
+}
+
+// Every square of the opening around (x, y) is uncovered, shows its
+// neighbour count from is_mine, and a blank one has no covered neighbour.
+// Returns how many squares the opening holds, rim included
+static size_t check_infinite_opening(InfiniteMineBoard* board, int x, int y, int* failures)
+{
+    std::vector<std::pair<int, int> > stack(1, std::make_pair(x, y));
+    std::unordered_map<uint64_t, int> seen;
+    seen[(uint64_t)(uint32_t)x << 32 | (uint32_t)y] = 1;
+    while (!stack.empty()) {
+        int nx = stack.back().first, ny = stack.back().second;
+        stack.pop_back();
+        int mines = 0;
+        for (int i = 0; i < 9; i++) { mines += i != 4 && board->is_mine(nx + i%3 - 1, ny + i/3 - 1); }
+        int shown = board->showSquare(nx, ny);
+        if (board->is_mine(nx, ny) || shown != mines) {
+            printf("  square %d,%d shows %d, %d mines around it\n", nx, ny, shown, mines);
+            (*failures)++;
+            return seen.size();
+        }
+        if (shown != 0) { continue; }
+        for (int i = 0; i < 9; i++) {
+            int sx = nx + i%3 - 1, sy = ny + i/3 - 1;
+            if (board->showSquare(sx, sy) == FLAG) { continue; }
+            uint64_t k = (uint64_t)(uint32_t)sx << 32 | (uint32_t)sy;
+            if (seen.count(k)) { continue; }
+            seen[k] = 1;
+            stack.push_back(std::make_pair(sx, sy));
+        }
+    }
+    return seen.size();
+}
+
+// InfiniteMineBoard openings match its own is_mine whatever chunks get
+// evicted on the way, and flags survive the first sweep rebuilding chunks
+int test_infinite_opening()
+{
+    int failures = 0;
+    size_t max_chunks[3] = { 1, 4, INFINITE_MAX_CHUNKS };
+    size_t revealed[3];
+    for (int i = 0; i < 3; i++) {
+        InfiniteMineBoard board(0.12, 5, max_chunks[i]);
+        board.flag(70, -3);  // near enough to be rebuilt by the first sweep
+        CHECK(board.sweep(-1, 1) == 0);
+        while (board.pendingReveal() > 0) { board.expand(); }
+        CHECK(board.status() == PLAYING);
+        CHECK(board.showSquare(70, -3) == FLAG && board.numFlags() == 1);
+        revealed[i] = board.numRevealed();
+        CHECK(check_infinite_opening(&board, -1, 1, &failures) == revealed[i]);
+        // Looking far away builds untouched chunks, the small caps evict them
+        // and the opening must come back the same
+        for (int k = 1; k <= 8; k++) { CHECK(board.showSquare(640*k, -640*k) == COVER); }
+        if (max_chunks[i] < 8) { CHECK(board.numEvicted() > 0); }
+        CHECK(check_infinite_opening(&board, -1, 1, &failures) == revealed[i]);
+    }
+    CHECK(revealed[0] == revealed[1] && revealed[1] == revealed[2]);
+
+    // Without mines a sweep stops at INFINITE_FLOOD_CAP, expand() carries on
+    InfiniteMineBoard empty(0, 5, 4);
+    empty.sweep(0, 0);
+    CHECK(empty.numRevealed() >= INFINITE_FLOOD_CAP && empty.pendingReveal() > 0);
+    size_t before = empty.numRevealed();
+    empty.expand(1000);
+    CHECK(empty.numRevealed() > before);
+    return failures;
+}
+
+struct Test
+{
+    const char* name;
+    int (*run)();
+};
+
+int main()
+{
+    Test tests[] = {
+        { "replay_lost_chord", test_replay_lost_chord },
+        { "replay_oversized_reset", test_replay_oversized_reset },
+        { "snapshot_tampered", test_snapshot_tampered },
+        { "create_out_of_memory", test_create_out_of_memory },
+        { "infinite_opening", test_infinite_opening },
+    };
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+        int failures = tests[i].run();
+        printf("%s %s\n", failures == 0 ? "ok  " : "FAIL", tests[i].name);
+        failed += failures != 0;
+    }
+    return failed != 0;
+}
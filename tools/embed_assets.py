@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+# Decode PNG images into RGBA pixel arrays for the game to build in.
+#
+# usage: embed_assets.py output.h image.png...
+#
+# Writes a header with one array per image, 4 bytes a pixel in R, G, B, A
+# order, rows top to bottom. Pixels of the colour key (0, 255, 255) get alpha 0,
+# as SDL_SetColorKey does for images loaded at run time. Only the standard
+# library is used: 8 bit, non interlaced PNGs of any colour type.
+
+import os
+import struct
+import sys
+import zlib
+
+COLOR_KEY = (0, 255, 255)
+CHANNELS = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    return b if pb <= pc else c
+
+
+def decode(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        raise ValueError('%s: not a PNG' % path)
+
+    pos = 8
+    idat = b''
+    palette = b''
+    transparency = b''
+    header = None
+    while pos < len(data):
+        length, kind = struct.unpack('>I4s', data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b'IHDR':
+            header = struct.unpack('>IIBBBBB', body)
+        elif kind == b'PLTE':
+            palette = body
+        elif kind == b'tRNS':
+            transparency = body
+        elif kind == b'IDAT':
+            idat += body
+        elif kind == b'IEND':
+            break
+
+    width, height, depth, color, _, _, interlace = header
+    if depth != 8 or interlace != 0 or color not in CHANNELS:
+        raise ValueError('%s: only 8 bit non interlaced images are supported' % path)
+    bpp = CHANNELS[color]
+    stride = width * bpp
+    raw = zlib.decompress(idat)
+
+    # Undo the per row filters
+    rows = []
+    prev = bytearray(stride)
+    for y in range(height):
+        start = y * (stride + 1)
+        kind = raw[start]
+        row = bytearray(raw[start + 1:start + 1 + stride])
+        for i in range(stride):
+            a = row[i - bpp] if i >= bpp else 0
+            b = prev[i]
+            c = prev[i - bpp] if i >= bpp else 0
+            if kind == 1:
+                row[i] = (row[i] + a) & 0xFF
+            elif kind == 2:
+                row[i] = (row[i] + b) & 0xFF
+            elif kind == 3:
+                row[i] = (row[i] + ((a + b) >> 1)) & 0xFF
+            elif kind == 4:
+                row[i] = (row[i] + paeth(a, b, c)) & 0xFF
+        rows.append(row)
+        prev = row
+
+    pixels = bytearray()
+    for row in rows:
+        for x in range(width):
+            p = row[x * bpp:(x + 1) * bpp]
+            if color == 0:
+                rgba = [p[0], p[0], p[0], 255]
+            elif color == 2:
+                rgba = [p[0], p[1], p[2], 255]
+            elif color == 3:
+                i = p[0]
+                rgba = list(palette[3 * i:3 * i + 3]) + [transparency[i] if i < len(transparency) else 255]
+            elif color == 4:
+                rgba = [p[0], p[0], p[0], p[1]]
+            else:
+                rgba = list(p)
+            if tuple(rgba[:3]) == COLOR_KEY:
+                rgba[3] = 0
+            pixels.extend(rgba)
+    return width, height, pixels
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.stderr.write('usage: embed_assets.py output.h image.png...\n')
+        return 1
+
+    out = ['// Generated by tools/embed_assets.py, do not edit', '',
+           '#ifndef EMBEDDED_ASSETS_H', '#define EMBEDDED_ASSETS_H', '',
+           'struct EmbeddedImage', '{',
+           '    const char* name;  // file name under assets/',
+           '    int width, height;',
+           '    const unsigned char* pixels;  // RGBA, width*height*4 bytes',
+           '};', '']
+    entries = []
+    for index, path in enumerate(sys.argv[2:]):
+        width, height, pixels = decode(path)
+        name = os.path.basename(path)
+        array = 'EMBEDDED_PIXELS_%d' % index
+        out.append('// %s, %dx%d' % (name, width, height))
+        out.append('static const unsigned char %s[] = {' % array)
+        for i in range(0, len(pixels), 16):
+            out.append('    ' + ', '.join('0x%02x' % v for v in pixels[i:i + 16]) + ',')
+        out.append('};')
+        out.append('')
+        entries.append('    { "%s", %d, %d, %s },' % (name, width, height, array))
+
+    out.append('static const EmbeddedImage EMBEDDED_IMAGES[] = {')
+    out.extend(entries)
+    out.append('};')
+    out.append('#define NUM_EMBEDDED_IMAGES %d' % len(entries))
+    out.append('')
+    out.append('#endif')
+
+    with open(sys.argv[1], 'w') as f:
+        f.write('\n'.join(out) + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
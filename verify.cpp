@@ -0,0 +1,118 @@
+// Replay verifier
+// Re-runs replay files on every core and checks each game's claimed result and time.
+//
+// usage: verify [-t threads] file...
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <MineBoard.cpp>
+#include <Replay.cpp>
+
+struct VerifyConfig
+{
+    char** files;
+    int num_files;
+    std::atomic<int> next_file;
+    std::atomic<long> unreadable;
+};
+
+// Files are taken one at a time from a shared counter, each worker keeps one board
+void worker_main(VerifyConfig* config, ReplayStats* stats)
+{
+    ReplayVerifier verifier;
+    int i;
+    while ((i = config->next_file++) < config->num_files) {
+        const char* path = config->files[i];
+        int fd = open(path, O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) < 0) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            if (fd >= 0) { close(fd); }
+            config->unreadable++;
+            continue;
+        }
+        size_t size = (size_t)info.st_size;
+        if (size == 0) {
+            close(fd);
+            stats->malformed++;
+            continue;
+        }
+
+        // Stream straight out of the page cache, read ahead does the rest
+        void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            config->unreadable++;
+            continue;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+        verifier.verify((const unsigned char*)map, size, stats);
+        munmap(map, size);
+    }
+}
+
+void usage()
+{
+    printf("usage: verify [-t threads] file...\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = (int)std::thread::hardware_concurrency();
+    if (threads < 1) { threads = 1; }
+
+    int i = 1;
+    while (i < argc && argv[i][0] == '-') {
+        if (strcmp(argv[i], "-t") == 0 && i+1 < argc) { threads = atoi(argv[i+1]); i += 2; }
+        else { usage(); return 1; }
+    }
+    if (i >= argc || threads < 1) { usage(); return 1; }
+
+    VerifyConfig config;
+    config.files = argv + i;
+    config.num_files = argc - i;
+    config.next_file = 0;
+    config.unreadable = 0;
+    if (threads > config.num_files) { threads = config.num_files; }
+
+    std::vector<ReplayStats> stats(threads);
+    memset(stats.data(), 0, sizeof(ReplayStats) * threads);
+    std::vector<std::thread> workers;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t=0; t<threads; t++) {
+        workers.push_back(std::thread(worker_main, &config, &stats[t]));
+    }
+    for (int t=0; t<threads; t++) {
+        workers[t].join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ReplayStats total;
+    memset(&total, 0, sizeof(total));
+    for (int t=0; t<threads; t++) {
+        total.games += stats[t].games;
+        total.verified += stats[t].verified;
+        total.wrong_status += stats[t].wrong_status;
+        total.wrong_time += stats[t].wrong_time;
+        total.illegal += stats[t].illegal;
+        total.unfinished += stats[t].unfinished;
+        total.malformed += stats[t].malformed;
+        total.events += stats[t].events;
+    }
+
+    printf("files       %d, %ld unreadable, %ld malformed\n", config.num_files, (long)config.unreadable, total.malformed);
+    printf("games       %ld in %.3f s (%.0f games/s, %.0f events/s), %d threads\n", total.games, seconds,
+        total.games / seconds, total.events / seconds, threads);
+    printf("verified    %ld\n", total.verified);
+    printf("rejected    %ld wrong status, %ld wrong time, %ld illegal moves\n",
+        total.wrong_status, total.wrong_time, total.illegal);
+    printf("unfinished  %ld\n", total.unfinished);
+
+    long failed = total.games - total.verified + total.malformed + config.unreadable;
+    return failed > 0 ? 2 : 0;
+}